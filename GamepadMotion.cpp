@@ -0,0 +1,6 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+// The one place the GamepadMotionHelpers_static library compiles the implementation. See the top of GamepadMotion.hpp.
+#define GAMEPADMOTION_IMPLEMENTATION
+#include "GamepadMotion.hpp"
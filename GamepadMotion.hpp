@@ -2,17 +2,113 @@
 // Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
 // Revision 4
 
+#pragma once
+
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <string.h> // memcmp and memcpy
 #include <algorithm> // std::min, std::max and std::clamp
+#include <type_traits> // std::is_trivially_copyable
+#include <atomic> // std::atomic for GamepadMotionPublisher
+#include <stdint.h> // int16_t for raw sensor input
+#include <float.h> // FLT_MAX
+
+// Define GAMEPADMOTION_SIMD before including this file to use SSE or NEON for Quat and Vec maths where available.
+// Results are the same as the scalar code (which is used otherwise), as long as your compiler isn't fusing multiply-adds.
+#if defined(GAMEPADMOTION_SIMD)
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GAMEPADMOTION_SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define GAMEPADMOTION_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+// Define GAMEPADMOTION_FAST_MATH before including this file to use cheaper approximations of exp2f, acosf, cosf, sinf and atan2f:
+// - Exp2: relative error below 1e-7 (about one float ulp) for inputs between -126 and 126
+// - Acos: absolute error below 6.8e-5 radians (0.004 degrees), relative error below 5e-5 for small angles
+// - Cos and Sin: absolute error below 4e-7 for inputs between -pi and pi, a little worse further out due to range reduction
+// - Atan2: absolute error about 1e-5 radians
+// sqrtf is left alone, since it's a single instruction on the platforms we care about.
+
+// Define GAMEPADMOTION_DETERMINISTIC before including this file to get bit-identical results from the same inputs on
+// every compiler and platform, for comparing replays or sharing motion state over a network. It uses the
+// GAMEPADMOTION_FAST_MATH approximations (plus sine and atan2) instead of the standard library's, since those differ
+// between platforms, and turns off fusing multiplies and adds for this file. sqrtf is exact everywhere, so it stays.
+// Floats must be evaluated as floats, so it can't be used with -ffast-math or x87 maths (use SSE2 on 32-bit x86).
+#if defined(GAMEPADMOTION_DETERMINISTIC)
+#include <float.h> // FLT_EVAL_METHOD
+#if defined(__FAST_MATH__) || defined(_M_FP_FAST)
+#error "GAMEPADMOTION_DETERMINISTIC can't be used with fast floating point options"
+#endif
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#error "GAMEPADMOTION_DETERMINISTIC needs floats evaluated as floats. On 32-bit x86, use SSE2 maths"
+#endif
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma float_control(push)
+#pragma fp_contract(off)
+#endif
+#endif
+
+// By default everything here is inline, so this file can be included from any number of source files. To compile the
+// implementation just once instead, define GAMEPADMOTION_SEPARATE_IMPLEMENTATION everywhere this file is included, and
+// also define GAMEPADMOTION_IMPLEMENTATION in exactly one source file before including it (or link the
+// GamepadMotionHelpers_static CMake target, which does both for you). Small Vec and Quat operations and templates stay
+// in the header either way so they can still be inlined.
+#if defined(GAMEPADMOTION_SEPARATE_IMPLEMENTATION)
+#define GAMEPADMOTION_API
+#if defined(GAMEPADMOTION_IMPLEMENTATION)
+#define GAMEPADMOTION_DEFINITIONS 1
+#else
+#define GAMEPADMOTION_DEFINITIONS 0
+#endif
+#else
+#define GAMEPADMOTION_API inline
+#define GAMEPADMOTION_DEFINITIONS 1
+#endif
+
+// Define GAMEPADMOTION_INSTRUMENTATION before including this file to have GamepadMotion count samples and calibration
+// events and time each stage of ProcessMotion, read with GetStats. Otherwise none of it is compiled in, and GetStats just
+// returns zeroes. Timings use GAMEPADMOTION_INSTRUMENTATION_TIMER(), which you can define as any expression giving a
+// uint64_t tick count (__rdtsc() for cycles, for example). By default it's std::chrono::steady_clock in nanoseconds.
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+#if !defined(GAMEPADMOTION_INSTRUMENTATION_TIMER)
+#include <chrono>
+#define GAMEPADMOTION_INSTRUMENTATION_TIMER() ((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+#define GAMEPADMOTION_STAT(statement) statement
+#else
+#define GAMEPADMOTION_STAT(statement)
+#endif
 
 // You don't need to look at these. These will just be used internally by the GamepadMotion class declared below.
 // You can ignore anything in namespace GamepadMotionHelpers.
 class GamepadMotionSettings;
+class GamepadMotionSettingsProfile;
+class GamepadMotionPublisher;
 class GamepadMotion;
+struct GamepadMotionDelta;
 
 namespace GamepadMotionHelpers
 {
+	struct MotionSample
+	{
+		float GyroX;
+		float GyroY;
+		float GyroZ;
+		float AccelX;
+		float AccelY;
+		float AccelZ;
+		float DeltaTime;
+	};
+
 	struct GyroCalibration
 	{
 		float X;
@@ -34,8 +130,9 @@ namespace GamepadMotionHelpers
 		void Set(float inW, float inX, float inY, float inZ);
 		Quat& operator*=(const Quat& rhs);
 		friend Quat operator*(Quat lhs, const Quat& rhs);
-		void Normalize();
+		void Normalize(); // keeps w, and scales x, y and z to fit
 		Quat Normalized() const;
+		void Renormalize(); // scales all four to unit length
 		void Invert();
 		Quat Inverse() const;
 	};
@@ -59,6 +156,7 @@ namespace GamepadMotionHelpers
 		Vec Min(const Vec& other) const;
 		Vec Max(const Vec& other) const;
 		Vec Abs() const;
+		Vec Sqrt() const;
 		Vec Lerp(const Vec& other, float factor) const;
 		Vec Lerp(const Vec& other, const Vec& factor) const;
 		Vec& operator+=(const Vec& rhs);
@@ -67,6 +165,8 @@ namespace GamepadMotionHelpers
 		friend Vec operator-(Vec lhs, const Vec& rhs);
 		Vec& operator*=(const float rhs);
 		friend Vec operator*(Vec lhs, const float rhs);
+		Vec& operator*=(const Vec& rhs); // component-wise
+		friend Vec operator*(Vec lhs, const Vec& rhs);
 		Vec& operator/=(const float rhs);
 		friend Vec operator/(Vec lhs, const float rhs);
 		Vec& operator*=(const Quat& rhs);
@@ -74,6 +174,16 @@ namespace GamepadMotionHelpers
 		Vec operator-() const;
 	};
 
+	// remembers the last result of Exp2 so that smoothing factors computed from a fixed deltaTime aren't worked out again
+	struct CachedExp2
+	{
+		float Input;
+		float Output;
+
+		CachedExp2();
+		float Get(float x);
+	};
+
 	struct SensorMinMaxWindow
 	{
 		Vec MinGyro;
@@ -82,6 +192,9 @@ namespace GamepadMotionHelpers
 		Vec MinAccel;
 		Vec MaxAccel;
 		Vec MeanAccel;
+		// sums of squared differences from the mean, for the variance
+		Vec SquaredDeviationGyro;
+		Vec SquaredDeviationAccel;
 		int NumSamples;
 		float TimeSampled;
 
@@ -89,6 +202,128 @@ namespace GamepadMotionHelpers
 		void Reset(float remainder);
 		void AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime);
 		Vec GetMidGyro();
+		Vec GetGyroStandardDeviation() const;
+		Vec GetAccelStandardDeviation() const;
+	};
+
+	// min, max, sum and sum of squared deviations of the samples in one slice of a SensorSlidingWindow
+	struct SensorWindowBucket
+	{
+		Vec MinGyro;
+		Vec MaxGyro;
+		Vec SumGyro;
+		Vec MinAccel;
+		Vec MaxAccel;
+		Vec SumAccel;
+		Vec SquaredDeviationGyro;
+		Vec SquaredDeviationAccel;
+		int NumSamples;
+		float TimeSampled;
+
+		void Clear();
+		void AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime);
+		void Combine(const SensorWindowBucket& other);
+	};
+
+	// Min, max, mean and variance over only the most recent WindowTime seconds of samples, in fixed memory. Samples are gathered
+	// into NumBuckets - 1 complete buckets plus the one being filled, so the window covers between WindowTime and
+	// WindowTime plus one bucket. Older buckets keep combined totals from each bucket through to the newest of them,
+	// and newer ones are combined as they complete, so each sample costs the same small amount of work no matter how
+	// long the window is. The older totals are rebuilt only when they've all expired.
+	struct SensorSlidingWindow
+	{
+		static const int NumBuckets = 8;
+
+		SensorWindowBucket Buckets[NumBuckets];
+		SensorWindowBucket OlderTotals[NumBuckets]; // OlderTotals[i] combines bucket i through to the newest older bucket
+		SensorWindowBucket NewerTotal; // combines complete buckets newer than the older ones
+		int Oldest;
+		int NumOlder;
+		int NumNewer; // including the bucket being filled
+		float BucketTime;
+
+		SensorSlidingWindow();
+		void Reset();
+		void AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime, float windowTime);
+		void GetWindow(SensorMinMaxWindow& outWindow) const;
+		void RebuildTotals();
+
+	private:
+		void MoveNewerToOlder();
+	};
+
+	// plain copies of internal state, used by GamepadMotionSnapshot
+	struct SensorWindowBucketSnapshot
+	{
+		float MinGyro[3];
+		float MaxGyro[3];
+		float SumGyro[3];
+		float MinAccel[3];
+		float MaxAccel[3];
+		float SumAccel[3];
+		float SquaredDeviationGyro[3];
+		float SquaredDeviationAccel[3];
+		int NumSamples;
+		float TimeSampled;
+	};
+
+	struct AutoCalibrationSnapshot
+	{
+		float MinGyro[3];
+		float MaxGyro[3];
+		float MeanGyro[3];
+		float MinAccel[3];
+		float MaxAccel[3];
+		float MeanAccel[3];
+		float SquaredDeviationGyro[3];
+		float SquaredDeviationAccel[3];
+		int WindowNumSamples;
+		float WindowTimeSampled;
+		float SmoothedAngularVelocityGyro[3];
+		float SmoothedAngularVelocityAccel[3];
+		float SmoothedPreviousAccel[3];
+		float PreviousAccel[3];
+		float MinDeltaGyro[3];
+		float MinDeltaAccel[3];
+		float NoiseFloorGyro[3];
+		float NoiseFloorAccel[3];
+		float RecalibrateThreshold;
+		float SensorFusionSkippedTime;
+		float TimeSteadySensorFusion;
+		float TimeSteadyStillness;
+		SensorWindowBucketSnapshot SlidingWindowBuckets[SensorSlidingWindow::NumBuckets];
+		int SlidingWindowOldest;
+		int SlidingWindowNumOlder;
+		int SlidingWindowNumNewer;
+		float SlidingWindowBucketTime;
+	};
+
+	struct MotionSnapshot
+	{
+		float Quaternion[4];
+		float Accel[3];
+		float Grav[3];
+		float ShortSmoothAccel[3];
+		float LongSmoothAccel[3];
+		float TimeCorrecting;
+		float MagneticReference[3];
+		float MagneticReferenceStrength;
+		float PreviousGyro[3];
+		int HasPreviousGyro;
+		int UpdatesSinceNormalize;
+	};
+
+	struct TemperatureBiasSnapshot
+	{
+		float Temperature;
+		int HasTemperature;
+		float ReferenceTemperature;
+		float SettleTimeLeft;
+		float SumWeight;
+		float SumTemperature;
+		float SumTemperatureSquared;
+		float SumBias[3];
+		float SumTemperatureBias[3];
 	};
 
 	struct AutoCalibration
@@ -105,40 +340,180 @@ namespace GamepadMotionHelpers
 		bool AddSampleSensorFusion(const Vec& inGyro, const Vec& inAccel, Vec& inOutVecMask, float deltaTime);
 		void NoSampleSensorFusion();
 		void SetCalibrationData(GyroCalibration* calibrationData);
-		void SetSettings(GamepadMotionSettings* settings);
+		void SetSettings(const GamepadMotionSettingsProfile* settings);
+		void SaveSnapshot(AutoCalibrationSnapshot& outSnapshot) const;
+		void LoadSnapshot(const AutoCalibrationSnapshot& snapshot);
+		// whether a snapshot's sliding window is safe to load, since it indexes into the buckets
+		static bool IsValidSnapshot(const AutoCalibrationSnapshot& snapshot);
+		float GetRecalibrateThreshold() const;
+		float GetTimeSteadyStillness() const;
 
 	private:
 		Vec MinDeltaGyro = Vec(10.f);
 		Vec MinDeltaAccel = Vec(10.f);
+		// smallest standard deviations seen through a whole window, for NoiseFloorStillness
+		Vec NoiseFloorGyro = Vec(10.f);
+		Vec NoiseFloorAccel = Vec(10.f);
 		float RecalibrateThreshold = 1.f;
 		float SensorFusionSkippedTime = 0.f;
 		float TimeSteadySensorFusion = 0.f;
 		float TimeSteadyStillness = 0.f;
 
+		CachedExp2 StillnessLerpExp2;
+		CachedExp2 SensorFusionSmoothingExp2;
+		CachedExp2 SensorFusionLerpExp2;
+
 		GyroCalibration* CalibrationData;
-		GamepadMotionSettings* Settings;
+		const GamepadMotionSettingsProfile* Settings;
+
+		// only used when StillnessWindowTime is more than 0. It's big, so it's last, away from what every sample uses
+		SensorSlidingWindow SlidingWindow;
 	};
 
 	struct Motion
 	{
+		// read and written by every update, so they're kept together
 		Quat Quaternion;
-		Vec Accel;
-		Vec Grav;
-
+		Quat LastGyroRotation; // the local rotation from gyro alone in the last update
+		Vec PreviousGyro; // only used by SecondOrderIntegration
+		bool HasPreviousGyro = false;
+		int UpdatesSinceNormalize = 0;
 		Vec ShortSmoothAccel;
 		Vec LongSmoothAccel;
-		const float ShortSteadinessHalfTime = 0.25f;
-		const float LongSteadinessHalfTime = 1.f;
-
 		float TimeCorrecting = 0.f;
 
+		CachedExp2 ShortSmoothExp2;
+		CachedExp2 LongSmoothExp2;
+		CachedExp2 CorrectExp2;
+
+		// Grav and Accel are worked out from these when they're next needed, so samples nobody reads them after don't pay for them
+		Quat PendingQuaternion;
+		Vec PendingAccel;
+		float PendingGravityLength = 0.f;
+		bool GravityPending = false;
+		bool AccelPending = false;
+
+		Vec Accel; // Accel and Grav are only up to date after ResolveGravity
+		Vec Grav;
+
+		// the horizontal direction of the magnetic field when the first magnetometer sample came in, which yaw is kept to
+		Vec MagneticReference;
+		float MagneticReferenceStrength = 0.f; // 0 until there's a reference
+		CachedExp2 MagnetometerCorrectExp2;
+
+		static constexpr float ShortSteadinessHalfTime = 0.25f;
+		static constexpr float LongSteadinessHalfTime = 1.f;
+		static constexpr float MinHeadingStrength = 0.1f; // the field's horizontal part, as a fraction of its strength, below which heading is too unreliable to use
+		static constexpr float MaxMagneticDisturbance = 0.25f; // how far the field's strength can stray from the reference's before it isn't trusted
+		static constexpr float SmallGravityErrorCosSquared = 0.96984631f; // cos(10 degrees) squared. Smaller gravity errors are corrected with small-angle approximations
+
 		Motion();
 		void Reset();
-		void Update(float inGyroX, float inGyroY, float inGyroZ, float inAccelX, float inAccelY, float inAccelZ, float gravityLength, float deltaTime);
-		void SetSettings(GamepadMotionSettings* settings);
+		template<bool ProcessAcceleration = true>
+		void Update(float inGyroX, float inGyroY, float inGyroZ, float inAccelX, float inAccelY, float inAccelZ, float gravityLength, float deltaTime,
+			const float* inMagnetometer = nullptr);
+		void ResolveGravity();
+		void SetSettings(const GamepadMotionSettingsProfile* settings);
+		void SaveSnapshot(MotionSnapshot& outSnapshot) const;
+		void LoadSnapshot(const MotionSnapshot& snapshot);
 
 	private:
-		GamepadMotionSettings* Settings;
+		const GamepadMotionSettingsProfile* Settings;
+	};
+
+	// running totals of calibrated gyro motion. Totals only ever grow, so that a reader can take the difference between
+	// two readings to get the motion in between without having to reset anything
+	struct GyroAccumulator
+	{
+		double AngleX;
+		double AngleY;
+		double AngleZ;
+		Quat Rotation;
+		double Time;
+		unsigned int NumSamples;
+
+		GyroAccumulator();
+		void Reset();
+		void AddSample(const Vec& inGyro, const Quat& inRotation, float deltaTime);
+		void GetTotals(GamepadMotionDelta& outDelta) const;
+	};
+
+	// the last few calibrated gyro samples, for estimating angular acceleration when predicting ahead
+	struct GyroHistory
+	{
+		static constexpr int Size = 16;
+		static constexpr float MaxAge = 0.05f; // older samples than this say more about past motion than about where it's heading
+
+		// each sample's gyro and deltaTime together, so adding a sample only writes to one place
+		struct Entry
+		{
+			Vec Gyro;
+			float DeltaTime;
+		};
+
+		int Newest;
+		int NumSamples;
+		Entry Entries[Size];
+
+		GyroHistory();
+		void Reset();
+		void AddSample(const Vec& inGyro, float deltaTime);
+		// least squares slope of gyro over time, in degrees per second per second
+		Vec GetAngularAcceleration() const;
+	};
+
+	// turns device timestamps into deltaTimes. Timestamps count up by ticksPerSecond every second and wrap around after numBits bits
+	struct TimestampTracker
+	{
+		double SecondsPerTick;
+		uint64_t Mask;
+		float SmoothingHalfTime;
+		static constexpr float MaxGap = 0.25f; // longer than this between samples and the controller was probably paused or disconnected
+
+		uint64_t LastTimestamp;
+		bool HasTimestamp;
+		float SmoothedDeltaTime;
+		float PendingTime; // time the timestamps have moved on that hasn't been given out as deltaTime yet
+
+		CachedExp2 SmoothingExp2;
+
+		TimestampTracker();
+		void SetFormat(double ticksPerSecond, int numBits, float smoothingHalfTime);
+		void Reset();
+		// the deltaTime to process a sample taken at timestamp with, or a negative number if it shouldn't be processed
+		// because it repeats the last timestamp or there's nothing to measure it from
+		float Update(uint64_t timestamp);
+	};
+
+	// a least squares line through gyro bias against temperature, built up from the calibration offset whenever
+	// auto-calibration changes it, so that the offset can follow temperature in between calibrations
+	struct TemperatureBiasFit
+	{
+		static constexpr float MaxWeight = 600.f; // seconds of calibration, after which older ones count for less and less
+		static constexpr float MinTemperatureSpread = 1.f; // how far temperatures have to spread (standard deviation) before there's a slope
+		static constexpr float SettleTime = 5.f; // seconds of calibration left out after calibration starts over, while the offset is still settling
+
+		float Temperature; // the latest temperature, which the calibration offset is kept up to date with
+		bool HasTemperature;
+		float ReferenceTemperature; // the sums are relative to the first temperature, to keep them small
+		float SettleTimeLeft;
+		float SumWeight;
+		float SumTemperature;
+		float SumTemperatureSquared;
+		Vec SumBias;
+		Vec SumTemperatureBias;
+
+		TemperatureBiasFit();
+		void Reset();
+		void SetTemperature(float temperature);
+		// ignore the calibration offset for a while, because calibration is starting over
+		void Unsettle();
+		// the bias at the current temperature, weighted by how long it was calibrated for
+		void AddSample(const Vec& inBias, float weight);
+		// change in bias per unit of temperature. False if temperatures haven't spread out enough to tell yet
+		bool GetSlope(Vec& outSlope) const;
+		void SaveSnapshot(TemperatureBiasSnapshot& outSnapshot) const;
+		void LoadSnapshot(const TemperatureBiasSnapshot& snapshot);
 	};
 
 	enum CalibrationMode
@@ -147,14 +522,34 @@ namespace GamepadMotionHelpers
 		Stillness = 1,
 		SensorFusion = 2,
 	};
+
+	// how Stillness calibration decides the controller is still, set with GamepadMotionSettings::StillnessDetection
+	enum StillnessMode
+	{
+		// the range (max - min) of each axis over the window, compared with the smallest range seen
+		RangeStillness = 0,
+		// the standard deviation of each axis over the window, compared with the smallest seen (the noise floor).
+		// A single outlier hardly moves it, and it doesn't grow as the window gets longer
+		NoiseFloorStillness = 1,
+	};
+
+	// how each gyro sample is turned into a rotation, set with GamepadMotionSettings::GyroIntegration
+	enum IntegrationMode
+	{
+		// rotate by this sample's angular velocity for the whole of deltaTime
+		FirstOrderIntegration = 0,
+		// rotate by the average of the last sample's angular velocity and this one's, plus the extra rotation that comes
+		// from the axis turning in between. Much more accurate at low sample rates, especially when the axis is changing
+		SecondOrderIntegration = 1,
+	};
 	
 	// https://stackoverflow.com/a/1448478/1130520
-	inline CalibrationMode operator|(CalibrationMode a, CalibrationMode b)
+	constexpr CalibrationMode operator|(CalibrationMode a, CalibrationMode b)
 	{
 	    return static_cast<CalibrationMode>(static_cast<int>(a) | static_cast<int>(b));
 	}
 	
-	inline CalibrationMode operator&(CalibrationMode a, CalibrationMode b)
+	constexpr CalibrationMode operator&(CalibrationMode a, CalibrationMode b)
 	{
 	    return static_cast<CalibrationMode>(static_cast<int>(a) & static_cast<int>(b));
 	}
@@ -174,6 +569,61 @@ namespace GamepadMotionHelpers
 	{
 		return (CalibrationMode&)((int&)(a) &= static_cast<int>(b));
 	}
+
+	// outputs a BasicGamepadMotion can be built with. Calibrated gyro is always available
+	enum MotionFeatures
+	{
+		GyroOnly = 0,
+		Orientation = 1, // orientation and gravity
+		ProcessedAcceleration = 2, // acceleration with gravity removed, which needs Orientation too
+		AllFeatures = Orientation | ProcessedAcceleration,
+	};
+
+	constexpr MotionFeatures operator|(MotionFeatures a, MotionFeatures b)
+	{
+		return static_cast<MotionFeatures>(static_cast<int>(a) | static_cast<int>(b));
+	}
+
+	constexpr MotionFeatures operator&(MotionFeatures a, MotionFeatures b)
+	{
+		return static_cast<MotionFeatures>(static_cast<int>(a) & static_cast<int>(b));
+	}
+
+	// what's changed in a GamepadMotion, from GamepadMotion::ConsumeChanges or a change callback
+	enum MotionChanges
+	{
+		NoChanges = 0,
+		MotionUpdated = 1, // a sample was processed, so gyro, orientation, gravity and acceleration may have changed
+		CalibrationChanged = 2, // the calibration offset changed
+		StillnessChanged = 4, // Stillness auto-calibration started or stopped treating the controller as still
+		GravitySteadyChanged = 8, // gravity correction started or stopped because acceleration became steady or shaky
+		AllChanges = MotionUpdated | CalibrationChanged | StillnessChanged | GravitySteadyChanged,
+	};
+
+	constexpr MotionChanges operator|(MotionChanges a, MotionChanges b)
+	{
+		return static_cast<MotionChanges>(static_cast<int>(a) | static_cast<int>(b));
+	}
+
+	constexpr MotionChanges operator&(MotionChanges a, MotionChanges b)
+	{
+		return static_cast<MotionChanges>(static_cast<int>(a) & static_cast<int>(b));
+	}
+
+	// stands in for a stage a BasicGamepadMotion has been built without
+	struct DisabledStage
+	{
+	};
+
+	// the per-sample step that GamepadMotion and BasicGamepadMotion share, so that they can't drift apart. Owner's
+	// HasAutoCalibration, HasOrientation and HasProcessedAcceleration choose the stages it runs, and HasFullState adds
+	// everything only GamepadMotion keeps: change flags, stats, the temperature fit, the magnetometer and gyro history
+	struct MotionStep
+	{
+		template<bool Calibrating, bool SensorFusion, bool Stillness, typename Owner>
+		static void Process(Owner& owner, float gyroX, float gyroY, float gyroZ,
+			float accelX, float accelY, float accelZ, float deltaTime, const float* magnetometer);
+	};
 }
 
 // Note that I'm using a Y-up coordinate system. This is to follow the convention set by the motion sensors in
@@ -194,6 +644,8 @@ public:
 	float StillnessErrorDropOnRecalibrate = 0.1f;
 	float StillnessCalibrationEaseInTime = 3.f;
 	float StillnessCalibrationHalfTime = 0.1f;
+	float StillnessWindowTime = 0.f;
+	GamepadMotionHelpers::StillnessMode StillnessDetection = GamepadMotionHelpers::RangeStillness;
 
 	float SensorFusionCalibrationSmoothingStrength = 2.f;
 	float SensorFusionAngularAccelerationThreshold = 20.f;
@@ -203,17 +655,214 @@ public:
 	float SteadyGravityThreshold = 0.03f;
 	float GravityCorrectEaseInTime = 0.25f;
 	float GravityCorrectHalfTime = 0.25f;
+	float GravityCorrectMinAngle = 0.05f; // degrees. Gravity that's already closer than this isn't corrected
+
+	float MagnetometerCorrectHalfTime = 2.f;
+
+	GamepadMotionHelpers::IntegrationMode GyroIntegration = GamepadMotionHelpers::FirstOrderIntegration;
+	int OrientationNormalizeInterval = 1; // how many samples between renormalizing the orientation
+};
+
+// A GamepadMotionSettingsProfile holds a copy of some settings along with values derived from them, which are only
+// worked out again when the settings are changed with SetSettings. Many GamepadMotion objects can share one profile
+// with SetSettingsProfile. Don't change a profile's settings while it's being used from another thread.
+class GamepadMotionSettingsProfile
+{
+public:
+	GamepadMotionSettingsProfile();
+	GamepadMotionSettingsProfile(const GamepadMotionSettings& settings);
+
+	void SetSettings(const GamepadMotionSettings& settings);
+	const GamepadMotionSettings& GetSettings() const;
+
+	// derived from the settings above. Inverse times are 0 when the time they're derived from is 0 or less
+	float StillnessCalibrationInverseEaseInTime;
+	float StillnessCalibrationInverseHalfTime;
+	float SensorFusionCalibrationInverseEaseInTime;
+	float SensorFusionCalibrationInverseHalfTime;
+	float SteadyGravityThresholdSquared;
+	float GravityCorrectInverseEaseInTime;
+	float GravityCorrectInverseHalfTime;
+	float GravityCorrectMinAngleCosSquared; // more than 1 when GravityCorrectMinAngle is 0, so correction is never skipped
+	float MagnetometerCorrectInverseHalfTime;
+
+private:
+	GamepadMotionSettings Settings;
+};
+
+// Everything a GamepadMotion has learned or is tracking, as a plain struct that can be copied with memcpy, saved to disk,
+// and loaded back into the same or a different GamepadMotion. Version and Size are checked when loading. Bump
+// CurrentVersion whenever the layout changes.
+struct GamepadMotionSnapshot
+{
+	static const int CurrentVersion = 7;
+
+	int Version;
+	int Size;
+	GamepadMotionSettings Settings;
+	GamepadMotionHelpers::GyroCalibration GyroCalibration;
+	GamepadMotionHelpers::MotionSnapshot Motion;
+	GamepadMotionHelpers::AutoCalibrationSnapshot AutoCalibration;
+	GamepadMotionHelpers::TemperatureBiasSnapshot TemperatureBias;
+	float Gyro[3];
+	float RawAccel[3];
+	int CalibrationMode;
+	int IsCalibrating;
+};
+
+static_assert(std::is_trivially_copyable<GamepadMotionSnapshot>::value, "GamepadMotionSnapshot must be memcpy-able");
+
+// Calibrated gyro motion over some period: the angular displacement in each local axis in degrees (gyro multiplied by
+// deltaTime and added up), the combined local rotation as a quaternion (w, x, y, z), and how long and how
+// many samples that was over.
+struct GamepadMotionDelta
+{
+	float GyroAngle[3];
+	float Rotation[4];
+	float Time;
+	int NumSamples;
+};
+
+// The outputs of a GamepadMotion at one moment, all from the same update
+struct GamepadMotionPublishedState
+{
+	float CalibratedGyro[3];
+	float Gravity[3];
+	float ProcessedAcceleration[3];
+	float Orientation[4];
+	// totals since the publisher was reset, for working out deltas
+	double TotalGyroAngle[3];
+	float TotalRotation[4];
+	double TotalTime;
+	unsigned int TotalSamples;
+	unsigned int Sequence;
+};
+
+// Passes GamepadMotion outputs from the thread calling ProcessMotion to one other thread without locking. Attach it
+// with GamepadMotion::SetPublisher, and every ProcessMotion or ProcessMotionBatch call publishes a complete copy of its
+// outputs once at the end. The reading thread calls Read or Consume. State is triple-buffered, so neither thread ever
+// waits for the other and reads are never torn. Only one thread may publish and only one thread may read.
+class GamepadMotionPublisher
+{
+public:
+	GamepadMotionPublisher();
+
+	// don't call while either thread is using the publisher
+	void Reset();
+
+	// the reading thread. Returns false if nothing has been published yet
+	bool Read(GamepadMotionPublishedState& outState);
+	// same as Read, and also gives the gyro motion since the previous Consume call (or since the first publish)
+	bool Consume(GamepadMotionPublishedState& outState, GamepadMotionDelta& outDelta);
+
+	// the publishing thread. GamepadMotion calls these for you
+	void AddSample(const GamepadMotionHelpers::Vec& inGyro, const GamepadMotionHelpers::Quat& inRotation, float deltaTime);
+	void Publish(GamepadMotion& motion);
+
+private:
+	static const unsigned int FreshFlag = 4;
+
+	struct alignas(64) Buffer
+	{
+		GamepadMotionPublishedState State;
+	};
+
+	Buffer Buffers[3];
+	alignas(64) std::atomic<unsigned int> Middle;
+
+	// owned by the publishing thread
+	alignas(64) unsigned int WriteIndex;
+	unsigned int PublishCount;
+	GamepadMotionHelpers::GyroAccumulator Totals;
+
+	// owned by the reading thread
+	alignas(64) unsigned int ReadIndex;
+	bool HasConsumed;
+	GamepadMotionPublishedState LastConsumed;
+};
+
+// What a GamepadMotion has been doing since it was created or since ResetStats. Only filled in when
+// GAMEPADMOTION_INSTRUMENTATION is defined. Times are in GAMEPADMOTION_INSTRUMENTATION_TIMER() ticks
+struct GamepadMotionStats
+{
+	uint64_t NumSamples;
+	// timestamped samples dropped for repeating the previous sample's timestamp
+	uint64_t DuplicateSamples;
+	uint64_t ManualCalibrationTime;
+	uint64_t SensorFusionTime;
+	uint64_t StillnessTime;
+	uint64_t MotionUpdateTime;
+	// samples on which each auto-calibration mode changed the calibration
+	uint64_t SensorFusionCalibrations;
+	uint64_t StillnessCalibrations;
+	// how many times Stillness decided the controller was being held still, and then that it had moved again
+	uint32_t StillnessEntered;
+	uint32_t StillnessExited;
+	uint32_t RecalibrateThresholdChanges;
+	float RecalibrateThreshold;
+	// how many times gravity correction started, and how long it's spent correcting in seconds
+	uint32_t GravityCorrectionsStarted;
+	double GravityCorrectionTime;
 };
 
-class GamepadMotion
+// called from ProcessMotion (or ProcessMotionBatch) right after the sample that caused the changes
+typedef void (*GamepadMotionChangeCallback)(GamepadMotion& motion, GamepadMotionHelpers::MotionChanges changes, void* userData);
+
+// aligned to a cache line, with the state every sample uses at the start, so that processing a sample touches as few
+// cache lines as possible
+class alignas(64) GamepadMotion
 {
 public:
 	GamepadMotion();
+	// calibration and settings point back into the object, so copies point theirs at themselves. A publisher only has
+	// one writer, so copying leaves the copy's publisher as it was (none, for a new one), and moving hands it over
+	GamepadMotion(const GamepadMotion& other);
+	GamepadMotion(GamepadMotion&& other) noexcept;
+	GamepadMotion& operator=(const GamepadMotion& other);
+	GamepadMotion& operator=(GamepadMotion&& other) noexcept;
 
 	void Reset();
 
 	void ProcessMotion(float gyroX, float gyroY, float gyroZ,
 		float accelX, float accelY, float accelZ, float deltaTime);
+	// with a magnetometer too, to correct yaw drift. The magnetometer can be in any units, but should already be
+	// calibrated for hard and soft iron. Yaw is kept to the heading when the first magnetometer sample came in
+	void ProcessMotion(float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ,
+		float magnetometerX, float magnetometerY, float magnetometerZ, float deltaTime);
+
+	// process several samples in one go. Each sample gets the same processing as a ProcessMotion call, but the calibration
+	// mode is only checked once per batch. If given, outCalibratedGyro receives 3 floats (x, y, z) per sample and
+	// outOrientation receives 4 floats (w, x, y, z) per sample.
+	void ProcessMotionBatch(const GamepadMotionHelpers::MotionSample* samples, int numSamples,
+		float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+	// same as above, but with interleaved xyz gyro and accel arrays (3 floats per sample) and one deltaTime per sample
+	void ProcessMotionBatch(const float* gyroXYZ, const float* accelXYZ, const float* deltaTimes, int numSamples,
+		float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+	// with interleaved xyz magnetometer readings too
+	void ProcessMotionBatch(const float* gyroXYZ, const float* accelXYZ, const float* magnetometerXYZ, const float* deltaTimes, int numSamples,
+		float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+
+	// raw sensor input, for feeding int16 counts straight from the controller. Set the scale once for the device: gyro
+	// scales are in degrees per second per count and accel scales are in g-force per count. A negative scale flips that axis
+	void SetRawSensorScale(float gyroScale, float accelScale);
+	void SetRawSensorScale(float gyroScaleX, float gyroScaleY, float gyroScaleZ, float accelScaleX, float accelScaleY, float accelScaleZ);
+	void ProcessMotionRaw(int16_t gyroX, int16_t gyroY, int16_t gyroZ, int16_t accelX, int16_t accelY, int16_t accelZ, float deltaTime);
+	// numSamples samples, each with xyz gyro at gyroXYZ and xyz accel at accelXYZ as little-endian int16s, and each
+	// strideBytes after the last. There are no alignment requirements, so these can point straight into a HID report.
+	// Samples are converted a small block at a time and processed as with ProcessMotionBatch.
+	void ProcessMotionBatchRaw(const void* gyroXYZ, const void* accelXYZ, int strideBytes, int numSamples, float deltaTime,
+		float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+
+	// timestamped input, for controllers that report when each sample was taken. Timestamps count up by ticksPerSecond
+	// every second and wrap around after numBits bits (by default, 64-bit microseconds). If smoothingHalfTime > 0, jitter
+	// in the deltaTime worked out from them is smoothed over about that long without drifting from the timestamps.
+	void SetTimestampFormat(double ticksPerSecond, int numBits = 64, float smoothingHalfTime = 0.f);
+	// returns false if the sample was skipped, because it repeats the last sample's timestamp or because it's the first
+	// sample since a Reset, which only sets the time to measure from. A long gap counts as one typical sample period
+	bool ProcessMotionTimestamped(float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ, uint64_t timestamp);
+	bool ProcessMotionRawTimestamped(int16_t gyroX, int16_t gyroY, int16_t gyroZ, int16_t accelX, int16_t accelY, int16_t accelZ, uint64_t timestamp);
 
 	// reading the current state
 	void GetCalibratedGyro(float& x, float& y, float& z);
@@ -221,6 +870,18 @@ public:
 	void GetProcessedAcceleration(float& x, float& y, float& z);
 	void GetOrientation(float& w, float& x, float& y, float& z);
 
+	// calibrated gyro motion over every sample since the last ConsumeAccumulatedGyro (or Reset). Get just reads it,
+	// Consume reads it and starts accumulating again from zero. Call Consume once per frame to get exactly the motion
+	// in that frame, however many samples it was made of.
+	void GetAccumulatedGyro(GamepadMotionDelta& outDelta);
+	void ConsumeAccumulatedGyro(GamepadMotionDelta& outDelta);
+
+	// extrapolate deltaTime seconds past the last sample, using the current calibrated gyro and its angular acceleration
+	// over the last few samples, to make up for latency between the last report and the frame being seen. Keep deltaTime
+	// short (tens of milliseconds at most), since the further ahead the prediction, the bigger its errors get.
+	void PredictCalibratedGyro(float deltaTime, float& x, float& y, float& z);
+	void PredictOrientation(float deltaTime, float& w, float& x, float& y, float& z);
+
 	// gyro calibration functions
 	void StartContinuousCalibration();
 	void PauseContinuousCalibration();
@@ -228,22 +889,322 @@ public:
 	void GetCalibrationOffset(float& xOffset, float& yOffset, float& zOffset);
 	void SetCalibrationOffset(float xOffset, float yOffset, float zOffset, int weight);
 
+	// for controllers that report their temperature, in any units as long as they're always the same. Auto-calibration
+	// learns how the calibration offset changes with temperature, and once it's seen enough of a spread, the offset
+	// follows temperature in between calibrations. Call it whenever the temperature comes in, before that sample's ProcessMotion
+	void SetTemperature(float temperature);
+	// how much the calibration offset changes per unit of temperature. Returns false if it can't tell yet
+	bool GetTemperatureBiasSlope(float& x, float& y, float& z);
+
 	GamepadMotionHelpers::CalibrationMode GetCalibrationMode();
 	void SetCalibrationMode(GamepadMotionHelpers::CalibrationMode calibrationMode);
 
 	void ResetMotion();
 
-	GamepadMotionSettings Settings;
+	// use a shared settings profile instead of Settings. The profile must outlive this object or be detached first by
+	// passing nullptr, which goes back to using Settings. Reset doesn't detach the profile.
+	void SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile);
+	const GamepadMotionSettingsProfile* GetSettingsProfile();
+
+	// save all internal state, including Settings but not an attached settings profile. LoadSnapshot returns false
+	// and changes nothing if the snapshot is from a different version, or is corrupt in a way that would be unsafe to load
+	void SaveSnapshot(GamepadMotionSnapshot& outSnapshot);
+	bool LoadSnapshot(const GamepadMotionSnapshot& snapshot);
+
+	// publish outputs to another thread after every ProcessMotion or ProcessMotionBatch. Pass nullptr to stop
+	void SetPublisher(GamepadMotionPublisher* publisher);
+
+	// see GAMEPADMOTION_INSTRUMENTATION at the top of this file
+	GamepadMotionStats GetStats();
+	void ResetStats();
+
+	// everything that's changed since the last ConsumeChanges, which then starts tracking changes again from nothing
+	GamepadMotionHelpers::MotionChanges ConsumeChanges();
+	// whether Stillness auto-calibration currently thinks the controller is still
+	bool IsStill();
+	// whether acceleration is currently steady enough to correct the orientation with gravity
+	bool IsGravitySteady();
+	// call back whenever processing a sample causes any of the given changes. Only one callback at a time. Pass nullptr to stop
+	void SetChangeCallback(GamepadMotionChangeCallback callback, GamepadMotionHelpers::MotionChanges changes = GamepadMotionHelpers::AllChanges,
+		void* userData = nullptr);
 
 private:
+	// read and written by every sample
+	GamepadMotionHelpers::Motion Motion;
 	GamepadMotionHelpers::Vec Gyro;
 	GamepadMotionHelpers::Vec RawAccel;
-	GamepadMotionHelpers::Motion Motion;
 	GamepadMotionHelpers::GyroCalibration GyroCalibration;
-	GamepadMotionHelpers::AutoCalibration AutoCalibration;
 	GamepadMotionHelpers::CalibrationMode CurrentCalibrationMode;
+	GamepadMotionHelpers::MotionChanges Changes;
+	bool IsCalibrating;
+	GamepadMotionHelpers::MotionChanges ChangeCallbackMask;
+	GamepadMotionChangeCallback ChangeCallback;
+	GamepadMotionPublisher* Publisher;
+	GamepadMotionHelpers::GyroAccumulator AccumulatedGyro;
+
+	// read by every sample, but only written when settings change
+	const GamepadMotionSettingsProfile* SharedSettingsProfile;
+	GamepadMotionSettingsProfile OwnSettingsProfile;
+
+	// only the parts for the current calibration mode are used, and its sliding window is at the end
+	GamepadMotionHelpers::AutoCalibration AutoCalibration;
+	GamepadMotionHelpers::TemperatureBiasFit TemperatureBias;
+	GamepadMotionHelpers::GyroHistory RecentGyro;
+
+	// only used by the functions that need them
+	GamepadMotionHelpers::Vec RawGyroScale;
+	GamepadMotionHelpers::Vec RawAccelScale;
+	GamepadMotionHelpers::TimestampTracker Timestamps;
+	void* ChangeCallbackUserData;
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+	GamepadMotionStats Stats;
+#endif
+
+public:
+	// after the internal state, since it's only checked for changes once per ProcessMotion or ProcessMotionBatch call
+	GamepadMotionSettings Settings;
+
+private:
+	friend struct GamepadMotionHelpers::MotionStep;
+	static constexpr bool HasAutoCalibration = true;
+	static constexpr bool HasOrientation = true;
+	static constexpr bool HasProcessedAcceleration = true;
+	static constexpr bool HasFullState = true;
+
+	void CopyState(const GamepadMotion& other);
+	void UpdateSettingsProfile();
+	void ProcessMotionSample(float gyroX, float gyroY, float gyroZ, float accelX, float accelY, float accelZ, float deltaTime, const float* magnetometer);
+	template<bool Calibrating, bool SensorFusion, bool Stillness>
+	void ProcessMotionLoop(const float* gyro, int gyroStride, const float* accel, int accelStride, const float* magnetometer, int magnetometerStride,
+		const float* deltaTimes, int deltaTimeStride, int numSamples, float* outCalibratedGyro, float* outOrientation);
+	void ProcessMotionStrided(const float* gyro, int gyroStride, const float* accel, int accelStride, const float* magnetometer, int magnetometerStride,
+		const float* deltaTimes, int deltaTimeStride, int numSamples, float* outCalibratedGyro, float* outOrientation);
+	void PushSensorSamples(float gyroX, float gyroY, float gyroZ, float accelMagnitude);
+	void GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY, float& gyroOffsetZ, float& accelMagnitude);
+};
+
+// one sample at the rate a GamepadMotionResampler outputs
+struct GamepadMotionResampledSample
+{
+	float CalibratedGyro[3]; // the average over the sample period, in degrees per second
+	float Orientation[4]; // w, x, y, z at the end of the sample period
+};
+
+// Feeds a GamepadMotion samples at whatever rate they come in, and outputs calibrated gyro and orientation at a fixed
+// rate. When samples come in faster than the output rate, they're averaged together so that the GamepadMotion only
+// processes about as many samples as are output. When they come in slower, orientation is interpolated in between.
+class GamepadMotionResampler
+{
+public:
+	GamepadMotionResampler();
+
+	void Reset();
+	void SetOutputRate(float samplesPerSecond);
+	float GetOutputRate();
+
+	// processes the sample with motion if it completes an output period, and writes every output sample that's now
+	// complete to outSamples, returning how many were written. Any more than maxOutSamples are dropped.
+	int ProcessMotion(GamepadMotion& motion, float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ, float deltaTime,
+		GamepadMotionResampledSample* outSamples, int maxOutSamples);
+
+private:
+	static constexpr float PeriodTolerance = 1e-4f; // fraction of a period that's near enough to its end to count as the end
+
+	float OutputPeriod;
+
+	// input that hasn't been processed yet
+	GamepadMotionHelpers::Vec InputGyroTotal;
+	GamepadMotionHelpers::Vec InputAccelTotal;
+	float InputTime;
+
+	// processed motion in the output period that hasn't been output yet
+	GamepadMotionHelpers::Vec OutputGyroTotal;
+	float OutputTime;
+};
+
+// GamepadMotionPool runs the same processing as GamepadMotion for up to MaxControllers controllers at once. The per-sample
+// state is stored as one array per field rather than one object per controller, and all controllers that have been given a
+// sample since the last ProcessMotion() are updated together. All controllers in a pool share the same Settings.
+template<int MaxControllers>
+class GamepadMotionPool
+{
+public:
+	GamepadMotionPool();
+	// copies point their auto-calibrations and settings at themselves, as with GamepadMotion
+	GamepadMotionPool(const GamepadMotionPool& other);
+	GamepadMotionPool(GamepadMotionPool&& other) noexcept;
+	GamepadMotionPool& operator=(const GamepadMotionPool& other);
+	GamepadMotionPool& operator=(GamepadMotionPool&& other) noexcept;
+
+	void Reset();
+	void Reset(int controller);
+
+	// queue a sample for this controller. Returns false if the controller already has a sample waiting to be processed
+	bool QueueMotion(int controller, float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ, float deltaTime);
+	// process every queued sample
+	void ProcessMotion();
+
+	// reading the current state
+	void GetCalibratedGyro(int controller, float& x, float& y, float& z);
+	void GetGravity(int controller, float& x, float& y, float& z);
+	void GetProcessedAcceleration(int controller, float& x, float& y, float& z);
+	void GetOrientation(int controller, float& w, float& x, float& y, float& z);
+
+	// gyro calibration functions
+	void StartContinuousCalibration(int controller);
+	void PauseContinuousCalibration(int controller);
+	void ResetContinuousCalibration(int controller);
+	void GetCalibrationOffset(int controller, float& xOffset, float& yOffset, float& zOffset);
+	void SetCalibrationOffset(int controller, float xOffset, float yOffset, float zOffset, int weight);
+
+	GamepadMotionHelpers::CalibrationMode GetCalibrationMode(int controller);
+	void SetCalibrationMode(int controller, GamepadMotionHelpers::CalibrationMode calibrationMode);
+
+	void ResetMotion(int controller);
+
+	// use a shared settings profile instead of Settings, same as with GamepadMotion
+	void SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile);
+	const GamepadMotionSettingsProfile* GetSettingsProfile();
+
+	// same as with GamepadMotion, except that settings are shared by the whole pool, so LoadSnapshot ignores them
+	void SaveSnapshot(int controller, GamepadMotionSnapshot& outSnapshot);
+	bool LoadSnapshot(int controller, const GamepadMotionSnapshot& snapshot);
+
+	GamepadMotionSettings Settings;
+
+private:
+	GamepadMotionSettingsProfile OwnSettingsProfile;
+	const GamepadMotionSettingsProfile* SharedSettingsProfile;
+	static constexpr float ShortSteadinessHalfTime = 0.25f;
+	static constexpr float LongSteadinessHalfTime = 1.f;
+
+	// queued input
+	alignas(64) float InGyroX[MaxControllers];
+	alignas(64) float InGyroY[MaxControllers];
+	alignas(64) float InGyroZ[MaxControllers];
+	alignas(64) float InAccelX[MaxControllers];
+	alignas(64) float InAccelY[MaxControllers];
+	alignas(64) float InAccelZ[MaxControllers];
+	alignas(64) float InDeltaTime[MaxControllers];
+	// int rather than a byte, so that the motion loop works on the same width of element throughout and can be vectorised
+	alignas(64) int Pending[MaxControllers];
+
+	// calibrated gyro and the gravity length it was calibrated with
+	alignas(64) float GyroX[MaxControllers];
+	alignas(64) float GyroY[MaxControllers];
+	alignas(64) float GyroZ[MaxControllers];
+	alignas(64) float GravityLength[MaxControllers];
+
+	// motion
+	alignas(64) float QuatW[MaxControllers];
+	alignas(64) float QuatX[MaxControllers];
+	alignas(64) float QuatY[MaxControllers];
+	alignas(64) float QuatZ[MaxControllers];
+	alignas(64) float AccelX[MaxControllers];
+	alignas(64) float AccelY[MaxControllers];
+	alignas(64) float AccelZ[MaxControllers];
+	alignas(64) float GravX[MaxControllers];
+	alignas(64) float GravY[MaxControllers];
+	alignas(64) float GravZ[MaxControllers];
+	alignas(64) float ShortSmoothAccelX[MaxControllers];
+	alignas(64) float ShortSmoothAccelY[MaxControllers];
+	alignas(64) float ShortSmoothAccelZ[MaxControllers];
+	alignas(64) float LongSmoothAccelX[MaxControllers];
+	alignas(64) float LongSmoothAccelY[MaxControllers];
+	alignas(64) float LongSmoothAccelZ[MaxControllers];
+	alignas(64) float TimeCorrecting[MaxControllers];
+
+	// calibration accumulators
+	alignas(64) float CalibrationX[MaxControllers];
+	alignas(64) float CalibrationY[MaxControllers];
+	alignas(64) float CalibrationZ[MaxControllers];
+	alignas(64) float CalibrationAccelMagnitude[MaxControllers];
+	alignas(64) int CalibrationNumSamples[MaxControllers];
+
+	// cold state, only touched by controllers with auto-calibration enabled
+	GamepadMotionHelpers::CalibrationMode CurrentCalibrationMode[MaxControllers];
+	bool IsCalibrating[MaxControllers];
+	GamepadMotionHelpers::AutoCalibration AutoCalibration[MaxControllers];
+	GamepadMotionHelpers::GyroCalibration ScratchCalibration;
+
+	int NumPending;
+	int PendingEnd;
+
+	const GamepadMotionSettingsProfile* GetActiveSettingsProfile();
+	void CopyState(const GamepadMotionPool& other);
+	void CalibrateQueued(int controller);
+	void UpdateMotionQueued(int end);
+};
+
+// BasicGamepadMotion does the same processing as GamepadMotion, but with its calibration mode and outputs chosen at
+// compile time. Stages it's built without aren't stored or run at all, so a Manual, GyroOnly BasicGamepadMotion is just
+// a gyro calibration. CalibrationModes may combine Stillness and SensorFusion as with SetCalibrationMode, and Features
+// chooses which of orientation/gravity and processed acceleration to work out. Reading an output that isn't built in
+// fails to compile. Results match a GamepadMotion using the same calibration mode.
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features = GamepadMotionHelpers::AllFeatures>
+class BasicGamepadMotion
+{
+public:
+	static constexpr bool HasStillness = (CalibrationModes & GamepadMotionHelpers::Stillness) != 0;
+	static constexpr bool HasSensorFusion = (CalibrationModes & GamepadMotionHelpers::SensorFusion) != 0;
+	static constexpr bool HasAutoCalibration = HasStillness || HasSensorFusion;
+	static constexpr bool HasOrientation = (Features & GamepadMotionHelpers::Orientation) != 0;
+	static constexpr bool HasProcessedAcceleration = HasOrientation && (Features & GamepadMotionHelpers::ProcessedAcceleration) != 0;
+
+	BasicGamepadMotion();
+	// copies point their calibration and settings at themselves, as with GamepadMotion
+	BasicGamepadMotion(const BasicGamepadMotion& other);
+	BasicGamepadMotion(BasicGamepadMotion&& other) noexcept;
+	BasicGamepadMotion& operator=(const BasicGamepadMotion& other);
+	BasicGamepadMotion& operator=(BasicGamepadMotion&& other) noexcept;
+
+	void Reset();
+
+	void ProcessMotion(float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ, float deltaTime);
+	void ProcessMotionBatch(const GamepadMotionHelpers::MotionSample* samples, int numSamples,
+		float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+
+	// reading the current state
+	void GetCalibratedGyro(float& x, float& y, float& z);
+	void GetGravity(float& x, float& y, float& z);
+	void GetProcessedAcceleration(float& x, float& y, float& z);
+	void GetOrientation(float& w, float& x, float& y, float& z);
+
+	// gyro calibration functions
+	void StartContinuousCalibration();
+	void PauseContinuousCalibration();
+	void ResetContinuousCalibration();
+	void GetCalibrationOffset(float& xOffset, float& yOffset, float& zOffset);
+	void SetCalibrationOffset(float xOffset, float yOffset, float zOffset, int weight);
+
+	GamepadMotionHelpers::CalibrationMode GetCalibrationMode();
+
+	void ResetMotion();
+
+	void SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile);
+	const GamepadMotionSettingsProfile* GetSettingsProfile();
+
+	GamepadMotionSettings Settings;
+
+private:
+	GamepadMotionSettingsProfile OwnSettingsProfile;
+	const GamepadMotionSettingsProfile* SharedSettingsProfile;
+	GamepadMotionHelpers::Vec Gyro;
+	typename std::conditional<HasOrientation, GamepadMotionHelpers::Motion, GamepadMotionHelpers::DisabledStage>::type Motion;
+	GamepadMotionHelpers::GyroCalibration GyroCalibration;
+	typename std::conditional<HasAutoCalibration, GamepadMotionHelpers::AutoCalibration, GamepadMotionHelpers::DisabledStage>::type AutoCalibration;
 
 	bool IsCalibrating;
+
+	friend struct GamepadMotionHelpers::MotionStep;
+	static constexpr bool HasFullState = false;
+
+	void CopyState(const BasicGamepadMotion& other);
+	void UpdateSettingsProfile();
+	void ProcessMotionStep(float gyroX, float gyroY, float gyroZ, float accelX, float accelY, float accelZ, float deltaTime);
 	void PushSensorSamples(float gyroX, float gyroY, float gyroZ, float accelMagnitude);
 	void GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY, float& gyroOffsetZ, float& accelMagnitude);
 };
@@ -252,53 +1213,245 @@ private:
 
 namespace GamepadMotionHelpers
 {
-	Quat::Quat()
+	inline float Exp2(float x)
 	{
-		w = 1.0f;
-		x = 0.0f;
-		y = 0.0f;
-		z = 0.0f;
+#if defined(GAMEPADMOTION_FAST_MATH) || defined(GAMEPADMOTION_DETERMINISTIC)
+		// 2^x = 2^whole * 2^fraction, with fraction in [-0.5, 0.5] approximated by a polynomial (Cephes exp2f)
+		x = x < -126.f ? -126.f : (x > 126.f ? 126.f : x);
+		const float shifted = x + 0.5f;
+		int whole = (int)shifted;
+		whole -= shifted < (float)whole ? 1 : 0;
+		const float fraction = x - (float)whole;
+		const float polynomial = ((((1.535336188319500e-4f * fraction + 1.339887440266574e-3f) * fraction + 9.618437357674640e-3f) * fraction
+			+ 5.550332471162809e-2f) * fraction + 2.402264791363012e-1f) * fraction + 6.931472028550421e-1f;
+		const unsigned int scaleBits = (unsigned int)(whole + 127) << 23;
+		float scale;
+		memcpy(&scale, &scaleBits, sizeof(float));
+		return (1.f + fraction * polynomial) * scale;
+#else
+		return exp2f(x);
+#endif
 	}
 
-	Quat::Quat(float inW, float inX, float inY, float inZ)
+	inline float Acos(float x)
 	{
-		w = inW;
-		x = inX;
-		y = inY;
-		z = inZ;
+#if defined(GAMEPADMOTION_FAST_MATH) || defined(GAMEPADMOTION_DETERMINISTIC)
+		// Abramowitz and Stegun 4.4.45. Inputs outside [-1, 1] are clamped
+		const float absX = x < 0.f ? -x : x;
+		const float oneMinusAbsX = absX > 1.f ? 0.f : 1.f - absX;
+		const float result = sqrtf(oneMinusAbsX) * (((-0.0187293f * absX + 0.0742610f) * absX - 0.2121144f) * absX + 1.5707288f);
+		return x < 0.f ? (float)M_PI - result : result;
+#else
+		return acosf(x);
+#endif
 	}
 
-	static Quat AngleAxis(float inAngle, float inX, float inY, float inZ)
+	inline float Cos(float x)
 	{
-		Quat result = Quat(cosf(inAngle * 0.5f), inX, inY, inZ);
-		result.Normalize();
-		return result;
+#if defined(GAMEPADMOTION_FAST_MATH) || defined(GAMEPADMOTION_DETERMINISTIC)
+		// reduce to [0, pi/2] and use the Taylor series up to x^12, which is accurate to float precision there. The
+		// reduction doesn't branch, so that GamepadMotionPool's loop can be vectorised. It takes off no whole turns in
+		// [0, pi), so it leaves those exactly as they are
+		x = x < 0.f ? -x : x;
+		x -= 2.f * (float)M_PI * (float)(int)((x + (float)M_PI) * (0.5f / (float)M_PI));
+		x = x < 0.f ? -x : x;
+		const bool reflect = x > 0.5f * (float)M_PI;
+		const float sign = reflect ? -1.f : 1.f;
+		x = reflect ? (float)M_PI - x : x;
+		const float x2 = x * x;
+		return sign * (1.f + x2 * (-1.f / 2.f + x2 * (1.f / 24.f + x2 * (-1.f / 720.f + x2 * (1.f / 40320.f + x2 * (-1.f / 3628800.f + x2 * (1.f / 479001600.f)))))));
+#else
+		return cosf(x);
+#endif
 	}
 
-	void Quat::Set(float inW, float inX, float inY, float inZ)
+	inline float Sin(float x)
 	{
-		w = inW;
-		x = inX;
-		y = inY;
-		z = inZ;
+#if defined(GAMEPADMOTION_FAST_MATH) || defined(GAMEPADMOTION_DETERMINISTIC)
+		return Cos(0.5f * (float)M_PI - x);
+#else
+		return sinf(x);
+#endif
 	}
 
-	Quat& Quat::operator*=(const Quat& rhs)
+	inline float Atan2(float y, float x)
 	{
-		Set(w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z,
-			w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y,
-			w * rhs.y - x * rhs.z + y * rhs.w + z * rhs.x,
-			w * rhs.z + x * rhs.y - y * rhs.x + z * rhs.w);
+#if defined(GAMEPADMOTION_FAST_MATH) || defined(GAMEPADMOTION_DETERMINISTIC)
+		// Abramowitz and Stegun 4.4.49 on the smaller over the larger, which is in [0, 1], then moved to the right octant.
+		// Absolute error about 1e-5 radians
+		const float absX = x < 0.f ? -x : x;
+		const float absY = y < 0.f ? -y : y;
+		const float larger = absX > absY ? absX : absY;
+		if (larger <= 0.f)
+		{
+			return 0.f;
+		}
+		const float ratio = (absX < absY ? absX : absY) / larger;
+		const float ratio2 = ratio * ratio;
+		float result = ((((0.0208351f * ratio2 - 0.085133f) * ratio2 + 0.180141f) * ratio2 - 0.3302995f) * ratio2 + 0.999866f) * ratio;
+		result = absY > absX ? 0.5f * (float)M_PI - result : result;
+		result = x < 0.f ? (float)M_PI - result : result;
+		return y < 0.f ? -result : result;
+#else
+		return atan2f(y, x);
+#endif
+	}
+
+	inline void StoreVec(const Vec& vec, float* out)
+	{
+		out[0] = vec.x;
+		out[1] = vec.y;
+		out[2] = vec.z;
+	}
+
+	inline Vec LoadVec(const float* in)
+	{
+		return Vec(in[0], in[1], in[2]);
+	}
+
+	// a little-endian int16 from anywhere in a buffer, however it's aligned
+	inline float LoadRawSensor(const unsigned char* in)
+	{
+		return (float)(int16_t)(uint16_t)(in[0] | (in[1] << 8));
+	}
+
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+	// ticks since lastTime, moving lastTime up to now
+	inline uint64_t StatLap(uint64_t& lastTime)
+	{
+		const uint64_t now = GAMEPADMOTION_INSTRUMENTATION_TIMER();
+		const uint64_t elapsed = now - lastTime;
+		lastTime = now;
+		return elapsed;
+	}
+#endif
+
+	inline CachedExp2::CachedExp2()
+	{
+		Input = NAN;
+		Output = NAN;
+	}
+
+	inline float CachedExp2::Get(float x)
+	{
+		if (x != Input)
+		{
+			Input = x;
+			Output = Exp2(x);
+		}
+		return Output;
+	}
+
+	inline Quat::Quat()
+	{
+		w = 1.0f;
+		x = 0.0f;
+		y = 0.0f;
+		z = 0.0f;
+	}
+
+	inline Quat::Quat(float inW, float inX, float inY, float inZ)
+	{
+		w = inW;
+		x = inX;
+		y = inY;
+		z = inZ;
+	}
+
+	inline Quat AngleAxis(float inAngle, float inX, float inY, float inZ)
+	{
+		Quat result = Quat(Cos(inAngle * 0.5f), inX, inY, inZ);
+		result.Normalize();
+		return result;
+	}
+
+	// spherical interpolation the short way round from one unit quaternion to another
+	inline Quat Slerp(const Quat& from, const Quat& to, float t)
+	{
+		float cosAngle = from.w * to.w + from.x * to.x + from.y * to.y + from.z * to.z;
+		const float sign = cosAngle < 0.f ? -1.f : 1.f;
+		cosAngle *= sign;
+
+		float fromFactor = 1.f - t;
+		float toFactor = t;
+		// close enough together and plain interpolation is just as good, and avoids dividing by almost nothing
+		if (cosAngle < 0.9995f)
+		{
+			const float angle = Acos(cosAngle);
+			const float inverseSinAngle = 1.f / Sin(angle);
+			fromFactor = Sin(fromFactor * angle) * inverseSinAngle;
+			toFactor = Sin(toFactor * angle) * inverseSinAngle;
+		}
+		toFactor *= sign;
+
+		Quat result = Quat(from.w * fromFactor + to.w * toFactor, from.x * fromFactor + to.x * toFactor,
+			from.y * fromFactor + to.y * toFactor, from.z * fromFactor + to.z * toFactor);
+		result.Normalize();
+		return result;
+	}
+
+	inline void Quat::Set(float inW, float inX, float inY, float inZ)
+	{
+		w = inW;
+		x = inX;
+		y = inY;
+		z = inZ;
+	}
+
+#if defined(GAMEPADMOTION_SIMD_SSE)
+	// each lane is w, x, y, z. Same terms in the same order as the scalar Quat::operator*=
+	inline __m128 SimdQuatMultiply(__m128 lhs, __m128 rhs)
+	{
+		const __m128 rhsXWZY = _mm_xor_ps(_mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(2, 3, 0, 1)), _mm_setr_ps(-0.f, 0.f, -0.f, 0.f));
+		const __m128 rhsYZWX = _mm_xor_ps(_mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 0, 3, 2)), _mm_setr_ps(-0.f, 0.f, 0.f, -0.f));
+		const __m128 rhsZYXW = _mm_xor_ps(_mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(0, 1, 2, 3)), _mm_setr_ps(-0.f, -0.f, 0.f, 0.f));
+		__m128 result = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(0, 0, 0, 0)), rhs);
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(1, 1, 1, 1)), rhsXWZY));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 2, 2, 2)), rhsYZWX));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(3, 3, 3, 3)), rhsZYXW));
+		return result;
+	}
+#elif defined(GAMEPADMOTION_SIMD_NEON)
+	// each lane is w, x, y, z. Same terms in the same order as the scalar Quat::operator*=
+	inline float32x4_t SimdQuatMultiply(float32x4_t lhs, float32x4_t rhs)
+	{
+		static const float signsXWZY[4] = { -1.f, 1.f, -1.f, 1.f };
+		static const float signsYZWX[4] = { -1.f, 1.f, 1.f, -1.f };
+		static const float signsZYXW[4] = { -1.f, -1.f, 1.f, 1.f };
+		const float32x4_t rhsYZWX = vextq_f32(rhs, rhs, 2);
+		const float32x4_t rhsXWZYSigned = vmulq_f32(vrev64q_f32(rhs), vld1q_f32(signsXWZY));
+		const float32x4_t rhsYZWXSigned = vmulq_f32(rhsYZWX, vld1q_f32(signsYZWX));
+		const float32x4_t rhsZYXWSigned = vmulq_f32(vrev64q_f32(rhsYZWX), vld1q_f32(signsZYXW));
+		float32x4_t result = vmulq_n_f32(rhs, vgetq_lane_f32(lhs, 0));
+		result = vaddq_f32(result, vmulq_n_f32(rhsXWZYSigned, vgetq_lane_f32(lhs, 1)));
+		result = vaddq_f32(result, vmulq_n_f32(rhsYZWXSigned, vgetq_lane_f32(lhs, 2)));
+		result = vaddq_f32(result, vmulq_n_f32(rhsZYXWSigned, vgetq_lane_f32(lhs, 3)));
+		return result;
+	}
+#endif
+
+	inline Quat& Quat::operator*=(const Quat& rhs)
+	{
+#if defined(GAMEPADMOTION_SIMD_SSE)
+		_mm_storeu_ps(&w, SimdQuatMultiply(_mm_loadu_ps(&w), _mm_loadu_ps(&rhs.w)));
+#elif defined(GAMEPADMOTION_SIMD_NEON)
+		vst1q_f32(&w, SimdQuatMultiply(vld1q_f32(&w), vld1q_f32(&rhs.w)));
+#else
+		Set(w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z,
+			w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y,
+			w * rhs.y - x * rhs.z + y * rhs.w + z * rhs.x,
+			w * rhs.z + x * rhs.y - y * rhs.x + z * rhs.w);
+#endif
 		return *this;
 	}
 
-	Quat operator*(Quat lhs, const Quat& rhs)
+	inline Quat operator*(Quat lhs, const Quat& rhs)
 	{
 		lhs *= rhs;
 		return lhs;
 	}
 
-	void Quat::Normalize()
+	inline void Quat::Normalize()
 	{
 		//printf("Normalizing: %.4f, %.4f, %.4f, %.4f\n", w, x, y, z);
 		const float length = sqrtf(x * x + y * y + z * z);
@@ -319,14 +1472,26 @@ namespace GamepadMotionHelpers
 		return;
 	}
 
-	Quat Quat::Normalized() const
+	inline Quat Quat::Normalized() const
 	{
 		Quat result = *this;
 		result.Normalize();
 		return result;
 	}
 
-	void Quat::Invert()
+	inline void Quat::Renormalize()
+	{
+		const float lengthSquared = w * w + x * x + y * y + z * z;
+		if (lengthSquared <= 0.0f)
+		{
+			Set(1.0f, 0.0f, 0.0f, 0.0f);
+			return;
+		}
+		const float fixFactor = 1.0f / sqrtf(lengthSquared);
+		Set(w * fixFactor, x * fixFactor, y * fixFactor, z * fixFactor);
+	}
+
+	inline void Quat::Invert()
 	{
 		x = -x;
 		y = -y;
@@ -334,52 +1499,52 @@ namespace GamepadMotionHelpers
 		return;
 	}
 
-	Quat Quat::Inverse() const
+	inline Quat Quat::Inverse() const
 	{
 		Quat result = *this;
 		result.Invert();
 		return result;
 	}
 
-	Vec::Vec()
+	inline Vec::Vec()
 	{
 		x = 0.0f;
 		y = 0.0f;
 		z = 0.0f;
 	}
 
-	Vec::Vec(float inValue)
+	inline Vec::Vec(float inValue)
 	{
 		x = inValue;
 		y = inValue;
 		z = inValue;
 	}
 
-	Vec::Vec(float inX, float inY, float inZ)
+	inline Vec::Vec(float inX, float inY, float inZ)
 	{
 		x = inX;
 		y = inY;
 		z = inZ;
 	}
 
-	void Vec::Set(float inX, float inY, float inZ)
+	inline void Vec::Set(float inX, float inY, float inZ)
 	{
 		x = inX;
 		y = inY;
 		z = inZ;
 	}
 
-	float Vec::Length() const
+	inline float Vec::Length() const
 	{
 		return sqrtf(x * x + y * y + z * z);
 	}
 
-	float Vec::LengthSquared() const
+	inline float Vec::LengthSquared() const
 	{
 		return x * x + y * y + z * z;
 	}
 
-	void Vec::Normalize()
+	inline void Vec::Normalize()
 	{
 		const float length = Length();
 		if (length == 0.0)
@@ -394,143 +1559,222 @@ namespace GamepadMotionHelpers
 		return;
 	}
 
-	Vec Vec::Normalized() const
+	inline Vec Vec::Normalized() const
 	{
 		Vec result = *this;
 		result.Normalize();
 		return result;
 	}
 
-	Vec& Vec::operator+=(const Vec& rhs)
+	inline Vec& Vec::operator+=(const Vec& rhs)
 	{
 		Set(x + rhs.x, y + rhs.y, z + rhs.z);
 		return *this;
 	}
 
-	Vec operator+(Vec lhs, const Vec& rhs)
+	inline Vec operator+(Vec lhs, const Vec& rhs)
 	{
 		lhs += rhs;
 		return lhs;
 	}
 
-	Vec& Vec::operator-=(const Vec& rhs)
+	inline Vec& Vec::operator-=(const Vec& rhs)
 	{
 		Set(x - rhs.x, y - rhs.y, z - rhs.z);
 		return *this;
 	}
 
-	Vec operator-(Vec lhs, const Vec& rhs)
+	inline Vec operator-(Vec lhs, const Vec& rhs)
 	{
 		lhs -= rhs;
 		return lhs;
 	}
 
-	Vec& Vec::operator*=(const float rhs)
+	inline Vec& Vec::operator*=(const float rhs)
 	{
 		Set(x * rhs, y * rhs, z * rhs);
 		return *this;
 	}
 
-	Vec operator*(Vec lhs, const float rhs)
+	inline Vec operator*(Vec lhs, const float rhs)
+	{
+		lhs *= rhs;
+		return lhs;
+	}
+
+	inline Vec& Vec::operator*=(const Vec& rhs)
+	{
+		Set(x * rhs.x, y * rhs.y, z * rhs.z);
+		return *this;
+	}
+
+	inline Vec operator*(Vec lhs, const Vec& rhs)
 	{
 		lhs *= rhs;
 		return lhs;
 	}
 
-	Vec& Vec::operator/=(const float rhs)
+	inline Vec& Vec::operator/=(const float rhs)
 	{
 		Set(x / rhs, y / rhs, z / rhs);
 		return *this;
 	}
 
-	Vec operator/(Vec lhs, const float rhs)
+	inline Vec operator/(Vec lhs, const float rhs)
 	{
 		lhs /= rhs;
 		return lhs;
 	}
 
-	Vec& Vec::operator*=(const Quat& rhs)
+	inline Vec& Vec::operator*=(const Quat& rhs)
 	{
+#if defined(GAMEPADMOTION_SIMD_SSE)
+		const __m128 rotation = _mm_loadu_ps(&rhs.w);
+		const __m128 inverse = _mm_xor_ps(rotation, _mm_setr_ps(0.f, -0.f, -0.f, -0.f));
+		float lanes[4];
+		_mm_storeu_ps(lanes, SimdQuatMultiply(SimdQuatMultiply(rotation, _mm_setr_ps(0.f, x, y, z)), inverse));
+		Set(lanes[1], lanes[2], lanes[3]);
+#elif defined(GAMEPADMOTION_SIMD_NEON)
+		static const float inverseSigns[4] = { 1.f, -1.f, -1.f, -1.f };
+		const float vecLanes[4] = { 0.f, x, y, z };
+		const float32x4_t rotation = vld1q_f32(&rhs.w);
+		const float32x4_t inverse = vmulq_f32(rotation, vld1q_f32(inverseSigns));
+		float lanes[4];
+		vst1q_f32(lanes, SimdQuatMultiply(SimdQuatMultiply(rotation, vld1q_f32(vecLanes)), inverse));
+		Set(lanes[1], lanes[2], lanes[3]);
+#else
 		Quat temp = rhs * Quat(0.0f, x, y, z) * rhs.Inverse();
 		Set(temp.x, temp.y, temp.z);
+#endif
 		return *this;
 	}
 
-	Vec operator*(Vec lhs, const Quat& rhs)
+	inline Vec operator*(Vec lhs, const Quat& rhs)
 	{
 		lhs *= rhs;
 		return lhs;
 	}
 
-	Vec Vec::operator-() const
+	inline Vec Vec::operator-() const
 	{
 		Vec result = Vec(-x, -y, -z);
 		return result;
 	}
 
-	float Vec::Dot(const Vec& other) const
+	inline float Vec::Dot(const Vec& other) const
 	{
 		return x * other.x + y * other.y + z * other.z;
 	}
 
-	Vec Vec::Cross(const Vec& other) const
+	inline Vec Vec::Cross(const Vec& other) const
 	{
 		return Vec(y * other.z - z * other.y,
 			z * other.x - x * other.z,
 			x * other.y - y * other.x);
 	}
 
-	Vec Vec::Min(const Vec& other) const
+	inline Vec Vec::Min(const Vec& other) const
 	{
 		return Vec(x < other.x ? x : other.x,
 			y < other.y ? y : other.y,
 			z < other.z ? z : other.z);
 	}
 	
-	Vec Vec::Max(const Vec& other) const
+	inline Vec Vec::Max(const Vec& other) const
 	{
 		return Vec(x > other.x ? x : other.x,
 			y > other.y ? y : other.y,
 			z > other.z ? z : other.z);
 	}
 
-	Vec Vec::Abs() const
+	inline Vec Vec::Abs() const
 	{
 		return Vec(x > 0 ? x : -x,
 			y > 0 ? y : -y,
 			z > 0 ? z : -z);
 	}
 
-	Vec Vec::Lerp(const Vec& other, float factor) const
+	inline Vec Vec::Sqrt() const
+	{
+		return Vec(sqrtf(x), sqrtf(y), sqrtf(z));
+	}
+
+	inline Vec Vec::Lerp(const Vec& other, float factor) const
 	{
+#if defined(GAMEPADMOTION_SIMD_SSE)
+		const __m128 thisVec = _mm_setr_ps(x, y, z, 0.f);
+		const __m128 result = _mm_add_ps(thisVec, _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(other.x, other.y, other.z, 0.f), thisVec), _mm_set1_ps(factor)));
+		float lanes[4];
+		_mm_storeu_ps(lanes, result);
+		return Vec(lanes[0], lanes[1], lanes[2]);
+#elif defined(GAMEPADMOTION_SIMD_NEON)
+		const float thisLanes[4] = { x, y, z, 0.f };
+		const float otherLanes[4] = { other.x, other.y, other.z, 0.f };
+		const float32x4_t thisVec = vld1q_f32(thisLanes);
+		const float32x4_t result = vaddq_f32(thisVec, vmulq_n_f32(vsubq_f32(vld1q_f32(otherLanes), thisVec), factor));
+		float lanes[4];
+		vst1q_f32(lanes, result);
+		return Vec(lanes[0], lanes[1], lanes[2]);
+#else
 		return *this + (other - *this) * factor;
+#endif
 	}
 
-	Vec Vec::Lerp(const Vec& other, const Vec& factor) const
+	inline Vec Vec::Lerp(const Vec& other, const Vec& factor) const
 	{
+#if defined(GAMEPADMOTION_SIMD_SSE)
+		const __m128 thisVec = _mm_setr_ps(x, y, z, 0.f);
+		const __m128 result = _mm_add_ps(thisVec, _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(other.x, other.y, other.z, 0.f), thisVec), _mm_setr_ps(factor.x, factor.y, factor.z, 0.f)));
+		float lanes[4];
+		_mm_storeu_ps(lanes, result);
+		return Vec(lanes[0], lanes[1], lanes[2]);
+#elif defined(GAMEPADMOTION_SIMD_NEON)
+		const float thisLanes[4] = { x, y, z, 0.f };
+		const float otherLanes[4] = { other.x, other.y, other.z, 0.f };
+		const float factorLanes[4] = { factor.x, factor.y, factor.z, 0.f };
+		const float32x4_t thisVec = vld1q_f32(thisLanes);
+		const float32x4_t result = vaddq_f32(thisVec, vmulq_f32(vsubq_f32(vld1q_f32(otherLanes), thisVec), vld1q_f32(factorLanes)));
+		float lanes[4];
+		vst1q_f32(lanes, result);
+		return Vec(lanes[0], lanes[1], lanes[2]);
+#else
 		return Vec(this->x + (other.x - this->x) * factor.x,
 			this->y + (other.y - this->y) * factor.y,
 			this->z + (other.z - this->z) * factor.z);
+#endif
 	}
 
-	Motion::Motion()
+#if GAMEPADMOTION_DEFINITIONS
+	GAMEPADMOTION_API Motion::Motion()
 	{
 		Reset();
 	}
 
-	void Motion::Reset()
+	GAMEPADMOTION_API void Motion::Reset()
 	{
 		Quaternion.Set(1.f, 0.f, 0.f, 0.f);
+		LastGyroRotation.Set(1.f, 0.f, 0.f, 0.f);
+		PreviousGyro.Set(0.f, 0.f, 0.f);
+		HasPreviousGyro = false;
+		UpdatesSinceNormalize = 0;
 		Accel.Set(0.f, 0.f, 0.f);
 		Grav.Set(0.f, 0.f, 0.f);
+		GravityPending = false;
+		AccelPending = false;
 		ShortSmoothAccel.Set(0.f, 0.f, 0.f);
 		LongSmoothAccel.Set(0.f, 0.f, 0.f);
+		MagneticReference.Set(0.f, 0.f, 0.f);
+		MagneticReferenceStrength = 0.f;
 	}
+#endif // GAMEPADMOTION_DEFINITIONS
 
 	/// <summary>
 	/// The gyro inputs should be calibrated degrees per second but have no other processing. Acceleration is in G units (1 = approx. 9.8m/s^2)
+	/// inMagnetometer is optional: 3 floats in any units, already calibrated for hard and soft iron
 	/// </summary>
-	void Motion::Update(float inGyroX, float inGyroY, float inGyroZ, float inAccelX, float inAccelY, float inAccelZ, float gravityLength, float deltaTime)
+	template<bool ProcessAcceleration>
+	void Motion::Update(float inGyroX, float inGyroY, float inGyroZ, float inAccelX, float inAccelY, float inAccelZ, float gravityLength, float deltaTime,
+		const float* inMagnetometer)
 	{
 		if (!Settings)
 		{
@@ -538,34 +1782,62 @@ namespace GamepadMotionHelpers
 		}
 
 		// get settings
-		const float steadyGravityThreshold = Settings->SteadyGravityThreshold;
-		const float GravityCorrectEaseInTime = Settings->GravityCorrectEaseInTime;
-		const float gravityCorrectHalfTime = Settings->GravityCorrectHalfTime;
+		const GamepadMotionSettings& settings = Settings->GetSettings();
+		const float steadyGravityThresholdSquared = Settings->SteadyGravityThresholdSquared;
+		const float GravityCorrectEaseInTime = settings.GravityCorrectEaseInTime;
+		const float gravityCorrectInverseEaseInTime = Settings->GravityCorrectInverseEaseInTime;
+		const float gravityCorrectInverseHalfTime = Settings->GravityCorrectInverseHalfTime;
+		const float gravityCorrectMinAngleCosSquared = Settings->GravityCorrectMinAngleCosSquared;
 
 		const Vec axis = Vec(inGyroX, inGyroY, inGyroZ);
 		const Vec accel = Vec(inAccelX, inAccelY, inAccelZ);
-		float angle = axis.Length() * (float)M_PI / 180.0f;
-		angle *= deltaTime;
 
 		// rotate
-		Quat rotation = AngleAxis(angle, axis.x, axis.y, axis.z);
+		Quat rotation;
+		if (settings.GyroIntegration == SecondOrderIntegration)
+		{
+			// the rotation vector over the sample, with angular velocity changing steadily from the last sample to this one:
+			// its average, and a twelfth of the cross product for the axis turning (the second term of the Magnus series)
+			const Vec previousGyro = HasPreviousGyro ? PreviousGyro : axis;
+			const float radiansPerDegree = (float)M_PI / 180.0f;
+			const float radiansThisSample = deltaTime * radiansPerDegree;
+			const Vec rotationVector = (previousGyro + axis) * (0.5f * radiansThisSample) +
+				previousGyro.Cross(axis) * (radiansThisSample * radiansThisSample * (1.f / 12.f));
+			PreviousGyro = axis;
+			HasPreviousGyro = true;
+
+			// built directly rather than with AngleAxis, which would round small rotations away
+			const float halfAngle = rotationVector.Length() * 0.5f;
+			const float halfAngleSquared = halfAngle * halfAngle;
+			// sin(halfAngle) / (2 * halfAngle). Its Taylor series is better than Sin for small angles, and exact enough up to 0.1
+			const float axisScale = halfAngle < 0.1f ?
+				0.5f * (1.f + halfAngleSquared * (-1.f / 6.f + halfAngleSquared * (1.f / 120.f))) :
+				Sin(halfAngle) / (2.f * halfAngle);
+			rotation = Quat(Cos(halfAngle), rotationVector.x * axisScale, rotationVector.y * axisScale, rotationVector.z * axisScale);
+		}
+		else
+		{
+			float angle = axis.Length() * (float)M_PI / 180.0f;
+			angle *= deltaTime;
+			rotation = AngleAxis(angle, axis.x, axis.y, axis.z);
+		}
 		Quaternion *= rotation; // do it this way because it's a local rotation, not global
+		LastGyroRotation = rotation;
 		//printf("Quat: %.4f %.4f %.4f %.4f _",
 		//	Quaternion.w, Quaternion.x, Quaternion.y, Quaternion.z);
 		float accelMagnitude = accel.Length();
 		if (accelMagnitude > 0.0f)
 		{
-			const Vec accelNorm = accel / accelMagnitude;
 			// for comparing and smoothing gravity samples, we need them to be global
 			Vec absoluteAccel = accel * Quaternion;
 			//printf("Absolute Accel: %.4f %.4f %.4f\n",
 			//	absoluteAccel.x, absoluteAccel.y, absoluteAccel.z);
-			const float shortSmoothFactor = ShortSteadinessHalfTime <= 0.f ? 0.f : exp2f(-deltaTime / ShortSteadinessHalfTime);
+			const float shortSmoothFactor = ShortSteadinessHalfTime <= 0.f ? 0.f : ShortSmoothExp2.Get(-deltaTime / ShortSteadinessHalfTime);
 			ShortSmoothAccel = absoluteAccel.Lerp(ShortSmoothAccel, shortSmoothFactor);
-			const float longSmoothFactor = LongSteadinessHalfTime <= 0.f ? 0.f : exp2f(-deltaTime / LongSteadinessHalfTime);
+			const float longSmoothFactor = LongSteadinessHalfTime <= 0.f ? 0.f : LongSmoothExp2.Get(-deltaTime / LongSteadinessHalfTime);
 			LongSmoothAccel = absoluteAccel.Lerp(LongSmoothAccel, longSmoothFactor);
 			//printf(" Gravity Box Size: %.4f _ ", gravityBoxSize.Length());
-			if ((LongSmoothAccel - ShortSmoothAccel).LengthSquared() <= steadyGravityThreshold*steadyGravityThreshold)
+			if ((LongSmoothAccel - ShortSmoothAccel).LengthSquared() <= steadyGravityThresholdSquared)
 			{
 				/*if (TimeCorrecting == 0.f)
 				{
@@ -573,29 +1845,44 @@ namespace GamepadMotionHelpers
 				}/**/
 				TimeCorrecting += deltaTime;
 
+				// the error angle's cosine is up / length for the smoothed acceleration, so compare squares to see how big
+				// it is without any square roots. A controller sitting still spends most of its time already close enough
 				absoluteAccel = ShortSmoothAccel;
-				const Vec gravityDirection = -absoluteAccel.Normalized();
-				const Vec expectedGravity = Vec(0.0f, -1.0f, 0.0f) * Quaternion.Inverse();
-				const float errorAngle = acosf(Vec(0.0f, -1.0f, 0.0f).Dot(gravityDirection)) * 180.0f / (float)M_PI;
-
-				const Vec flattened = gravityDirection.Cross(Vec(0.0f, -1.0f, 0.0f)).Normalized();
-
-				if (errorAngle > 0.0f)
+				const float accelLengthSquared = absoluteAccel.LengthSquared();
+				const float upAccel = absoluteAccel.y;
+				const float upAccelSquared = upAccel * upAccel;
+				if (upAccel <= 0.0f || upAccelSquared < gravityCorrectMinAngleCosSquared * accelLengthSquared)
 				{
-					const float correctFactor = gravityCorrectHalfTime <= 0.f ? 0.f : exp2f(-deltaTime / gravityCorrectHalfTime);
-					float confidentSmoothCorrect = errorAngle;
-					confidentSmoothCorrect *= 1.0f - correctFactor;
-
+					const float correctFactor = gravityCorrectInverseHalfTime <= 0.f ? 0.f : CorrectExp2.Get(-deltaTime * gravityCorrectInverseHalfTime);
+					float correctAmount = 1.0f - correctFactor;
 					if (TimeCorrecting < GravityCorrectEaseInTime)
 					{
-						confidentSmoothCorrect *= TimeCorrecting / GravityCorrectEaseInTime;
+						correctAmount *= TimeCorrecting * gravityCorrectInverseEaseInTime;
 					}
 
-					Quaternion = AngleAxis(confidentSmoothCorrect * (float)M_PI / 180.0f, flattened.x, flattened.y, flattened.z) * Quaternion;
+					const Vec gravityDirection = -absoluteAccel.Normalized();
+					// the axis to correct around, with a length of sin(error angle)
+					const Vec errorAxis = gravityDirection.Cross(Vec(0.0f, -1.0f, 0.0f));
+					// either way the correction is built directly, since AngleAxis would round small corrections away
+					if (upAccel > 0.0f && upAccelSquared >= SmallGravityErrorCosSquared * accelLengthSquared)
+					{
+						// sin(error angle) is close enough to the error angle, and half the correction close enough to its sine
+						const Vec halfCorrect = errorAxis * (0.5f * correctAmount);
+						Quaternion = Quat(1.0f - 0.5f * halfCorrect.LengthSquared(), halfCorrect.x, halfCorrect.y, halfCorrect.z) * Quaternion;
+					}
+					else
+					{
+						const float errorAngle = Acos(Vec(0.0f, -1.0f, 0.0f).Dot(gravityDirection));
+						const Vec flattened = errorAxis.Normalized();
+						if (errorAngle > 0.0f)
+						{
+							const float halfCorrectAngle = errorAngle * correctAmount * 0.5f;
+							const float sinHalfCorrectAngle = Sin(halfCorrectAngle);
+							Quaternion = Quat(Cos(halfCorrectAngle), flattened.x * sinHalfCorrectAngle, flattened.y * sinHalfCorrectAngle,
+								flattened.z * sinHalfCorrectAngle) * Quaternion;
+						}
+					}
 				}
-
-				Grav = Vec(0.0f, -gravityLength, 0.0f) * Quaternion.Inverse();
-				Accel = accel + Grav; // gravity won't be shaky. accel might. so let's keep using the quaternion's calculated gravity vector.
 			}
 			else
 			{
@@ -605,35 +1892,130 @@ namespace GamepadMotionHelpers
 				}/**/
 
 				TimeCorrecting = 0.0f;
-				Grav = Vec(0.0f, -gravityLength, 0.0f) * Quaternion.Inverse();
-				Accel = accel + Grav;
 			}
+
+			// gravity won't be shaky. accel might. so Grav (and Accel from it) will come from the quaternion's calculated gravity vector
+			PendingQuaternion = Quaternion;
+			PendingAccel = accel;
+			PendingGravityLength = gravityLength;
+			GravityPending = true;
+			AccelPending = ProcessAcceleration;
 		}
 		else
 		{
 			TimeCorrecting = 0.0f;
 			Accel.Set(0.0f, 0.0f, 0.0f);
+			AccelPending = false;
+		}
+
+		if (inMagnetometer != nullptr)
+		{
+			// gravity can't correct yaw, but the magnetic field's direction across the horizontal plane can
+			const Vec magnetometer = Vec(inMagnetometer[0], inMagnetometer[1], inMagnetometer[2]);
+			const float magneticStrength = magnetometer.Length();
+			const Vec absoluteMagnetometer = magnetometer * Quaternion;
+			const Vec heading = Vec(absoluteMagnetometer.x, 0.0f, absoluteMagnetometer.z);
+			const float headingStrength = heading.Length();
+			if (magneticStrength > 0.0f && headingStrength > MinHeadingStrength * magneticStrength)
+			{
+				const Vec headingDirection = heading / headingStrength;
+				if (MagneticReferenceStrength <= 0.0f)
+				{
+					MagneticReference = headingDirection;
+					MagneticReferenceStrength = magneticStrength;
+				}
+				else if (fabsf(magneticStrength - MagneticReferenceStrength) <= MaxMagneticDisturbance * MagneticReferenceStrength)
+				{
+					// yaw error is the angle from the reference heading to this one around the vertical axis
+					const float sinError = headingDirection.z * MagneticReference.x - headingDirection.x * MagneticReference.z;
+					const float cosError = headingDirection.Dot(MagneticReference);
+					const float errorAngle = Atan2(sinError, cosError);
+					const float magnetometerCorrectInverseHalfTime = Settings->MagnetometerCorrectInverseHalfTime;
+					const float correctFactor = magnetometerCorrectInverseHalfTime <= 0.f ? 0.f : MagnetometerCorrectExp2.Get(-deltaTime * magnetometerCorrectInverseHalfTime);
+					// built directly rather than with AngleAxis, since these corrections are small enough that AngleAxis would round them away
+					const float halfCorrectAngle = errorAngle * (1.0f - correctFactor) * 0.5f;
+					Quaternion = Quat(Cos(halfCorrectAngle), 0.0f, Sin(halfCorrectAngle), 0.0f) * Quaternion;
+				}
+			}
+		}
+
+		// every rotation above is already unit length, so rounding error builds up slowly enough to not fix every time.
+		// Renormalize rather than Normalize, which would lose small changes near no rotation at all when w rounds to 1
+		UpdatesSinceNormalize++;
+		if (UpdatesSinceNormalize >= settings.OrientationNormalizeInterval)
+		{
+			Quaternion.Renormalize();
+			UpdatesSinceNormalize = 0;
+		}
+	}
+
+#if GAMEPADMOTION_DEFINITIONS
+	GAMEPADMOTION_API void Motion::ResolveGravity()
+	{
+		if (GravityPending)
+		{
+			Grav = Vec(0.0f, -PendingGravityLength, 0.0f) * PendingQuaternion.Inverse();
+			GravityPending = false;
+			if (AccelPending)
+			{
+				Accel = PendingAccel + Grav;
+				AccelPending = false;
+			}
 		}
-		Quaternion.Normalize();
 	}
 
-	void Motion::SetSettings(GamepadMotionSettings* settings)
+	GAMEPADMOTION_API void Motion::SetSettings(const GamepadMotionSettingsProfile* settings)
 	{
 		Settings = settings;
 	}
 
-	SensorMinMaxWindow::SensorMinMaxWindow()
+	GAMEPADMOTION_API void Motion::SaveSnapshot(MotionSnapshot& outSnapshot) const
+	{
+		outSnapshot.Quaternion[0] = Quaternion.w;
+		outSnapshot.Quaternion[1] = Quaternion.x;
+		outSnapshot.Quaternion[2] = Quaternion.y;
+		outSnapshot.Quaternion[3] = Quaternion.z;
+		StoreVec(Accel, outSnapshot.Accel);
+		StoreVec(Grav, outSnapshot.Grav);
+		StoreVec(ShortSmoothAccel, outSnapshot.ShortSmoothAccel);
+		StoreVec(LongSmoothAccel, outSnapshot.LongSmoothAccel);
+		outSnapshot.TimeCorrecting = TimeCorrecting;
+		StoreVec(MagneticReference, outSnapshot.MagneticReference);
+		outSnapshot.MagneticReferenceStrength = MagneticReferenceStrength;
+		StoreVec(PreviousGyro, outSnapshot.PreviousGyro);
+		outSnapshot.HasPreviousGyro = HasPreviousGyro ? 1 : 0;
+		outSnapshot.UpdatesSinceNormalize = UpdatesSinceNormalize;
+	}
+
+	GAMEPADMOTION_API void Motion::LoadSnapshot(const MotionSnapshot& snapshot)
+	{
+		Quaternion.Set(snapshot.Quaternion[0], snapshot.Quaternion[1], snapshot.Quaternion[2], snapshot.Quaternion[3]);
+		Accel = LoadVec(snapshot.Accel);
+		Grav = LoadVec(snapshot.Grav);
+		GravityPending = false;
+		AccelPending = false;
+		ShortSmoothAccel = LoadVec(snapshot.ShortSmoothAccel);
+		LongSmoothAccel = LoadVec(snapshot.LongSmoothAccel);
+		TimeCorrecting = snapshot.TimeCorrecting;
+		MagneticReference = LoadVec(snapshot.MagneticReference);
+		MagneticReferenceStrength = snapshot.MagneticReferenceStrength;
+		PreviousGyro = LoadVec(snapshot.PreviousGyro);
+		HasPreviousGyro = snapshot.HasPreviousGyro != 0;
+		UpdatesSinceNormalize = snapshot.UpdatesSinceNormalize;
+	}
+
+	GAMEPADMOTION_API SensorMinMaxWindow::SensorMinMaxWindow()
 	{
 		Reset(0.f);
 	}
 
-	void SensorMinMaxWindow::Reset(float remainder)
+	GAMEPADMOTION_API void SensorMinMaxWindow::Reset(float remainder)
 	{
 		NumSamples = 0;
 		TimeSampled = remainder;
 	}
 
-	void SensorMinMaxWindow::AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime)
+	GAMEPADMOTION_API void SensorMinMaxWindow::AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime)
 	{
 		if (NumSamples == 0)
 		{
@@ -643,6 +2025,8 @@ namespace GamepadMotionHelpers
 			MaxAccel = inAccel;
 			MinAccel = inAccel;
 			MeanAccel = inAccel;
+			SquaredDeviationGyro = Vec();
+			SquaredDeviationAccel = Vec();
 			NumSamples = 1;
 			TimeSampled += deltaTime;
 			return;
@@ -659,23 +2043,216 @@ namespace GamepadMotionHelpers
 		// https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm
 		Vec delta = inGyro - MeanGyro;
 		MeanGyro += delta * (1.f / NumSamples);
+		SquaredDeviationGyro += delta * (inGyro - MeanGyro);
 		delta = inAccel - MeanAccel;
 		MeanAccel += delta * (1.f / NumSamples);
+		SquaredDeviationAccel += delta * (inAccel - MeanAccel);
 	}
 
-	Vec SensorMinMaxWindow::GetMidGyro()
+	GAMEPADMOTION_API Vec SensorMinMaxWindow::GetMidGyro()
 	{
 		return MeanGyro;
 	}
 
-	AutoCalibration::AutoCalibration()
+	GAMEPADMOTION_API Vec SensorMinMaxWindow::GetGyroStandardDeviation() const
+	{
+		return NumSamples > 0 ? (SquaredDeviationGyro * (1.f / NumSamples)).Sqrt() : Vec();
+	}
+
+	GAMEPADMOTION_API Vec SensorMinMaxWindow::GetAccelStandardDeviation() const
+	{
+		return NumSamples > 0 ? (SquaredDeviationAccel * (1.f / NumSamples)).Sqrt() : Vec();
+	}
+
+	GAMEPADMOTION_API void SensorWindowBucket::Clear()
+	{
+		NumSamples = 0;
+		TimeSampled = 0.f;
+	}
+
+	GAMEPADMOTION_API void SensorWindowBucket::AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime)
+	{
+		if (NumSamples == 0)
+		{
+			MinGyro = inGyro;
+			MaxGyro = inGyro;
+			SumGyro = inGyro;
+			MinAccel = inAccel;
+			MaxAccel = inAccel;
+			SumAccel = inAccel;
+			SquaredDeviationGyro = Vec();
+			SquaredDeviationAccel = Vec();
+			NumSamples = 1;
+			TimeSampled = deltaTime;
+			return;
+		}
+
+		// Welford's update, written with the sum instead of the mean: (x - mean)^2 * n / (n + 1)
+		const float numSamples = (float)NumSamples;
+		const float deviationWeight = 1.f / (numSamples * (numSamples + 1.f));
+		const Vec gyroDelta = inGyro * numSamples - SumGyro;
+		const Vec accelDelta = inAccel * numSamples - SumAccel;
+		SquaredDeviationGyro += gyroDelta * gyroDelta * deviationWeight;
+		SquaredDeviationAccel += accelDelta * accelDelta * deviationWeight;
+
+		MinGyro = MinGyro.Min(inGyro);
+		MaxGyro = MaxGyro.Max(inGyro);
+		SumGyro += inGyro;
+		MinAccel = MinAccel.Min(inAccel);
+		MaxAccel = MaxAccel.Max(inAccel);
+		SumAccel += inAccel;
+		NumSamples++;
+		TimeSampled += deltaTime;
+	}
+
+	GAMEPADMOTION_API void SensorWindowBucket::Combine(const SensorWindowBucket& other)
+	{
+		if (other.NumSamples == 0)
+		{
+			return;
+		}
+
+		if (NumSamples == 0)
+		{
+			*this = other;
+			return;
+		}
+
+		// https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Parallel_algorithm
+		const float numSamples = (float)NumSamples;
+		const float otherNumSamples = (float)other.NumSamples;
+		const float deviationWeight = 1.f / (numSamples * otherNumSamples * (numSamples + otherNumSamples));
+		const Vec gyroDelta = other.SumGyro * numSamples - SumGyro * otherNumSamples;
+		const Vec accelDelta = other.SumAccel * numSamples - SumAccel * otherNumSamples;
+		SquaredDeviationGyro += other.SquaredDeviationGyro + gyroDelta * gyroDelta * deviationWeight;
+		SquaredDeviationAccel += other.SquaredDeviationAccel + accelDelta * accelDelta * deviationWeight;
+
+		MinGyro = MinGyro.Min(other.MinGyro);
+		MaxGyro = MaxGyro.Max(other.MaxGyro);
+		SumGyro += other.SumGyro;
+		MinAccel = MinAccel.Min(other.MinAccel);
+		MaxAccel = MaxAccel.Max(other.MaxAccel);
+		SumAccel += other.SumAccel;
+		NumSamples += other.NumSamples;
+		TimeSampled += other.TimeSampled;
+	}
+
+	GAMEPADMOTION_API SensorSlidingWindow::SensorSlidingWindow()
+	{
+		// Reset only clears the first bucket, and the rest are cleared as they come into use. Snapshots save all of
+		// them, so start them all empty rather than with whatever was in memory
+		for (int i = 0; i < NumBuckets; i++)
+		{
+			Buckets[i].Clear();
+		}
+		Reset();
+	}
+
+	GAMEPADMOTION_API void SensorSlidingWindow::Reset()
+	{
+		Buckets[0].Clear();
+		NewerTotal.Clear();
+		Oldest = 0;
+		NumOlder = 0;
+		NumNewer = 1;
+		BucketTime = 0.f;
+	}
+
+	GAMEPADMOTION_API void SensorSlidingWindow::AddSample(const Vec& inGyro, const Vec& inAccel, float deltaTime, float windowTime)
+	{
+		const float bucketTime = windowTime * (1.f / (NumBuckets - 1));
+		if (bucketTime != BucketTime)
+		{
+			Reset();
+			BucketTime = bucketTime;
+		}
+
+		SensorWindowBucket& current = Buckets[(Oldest + NumOlder + NumNewer - 1) % NumBuckets];
+		current.AddSample(inGyro, inAccel, deltaTime);
+		if (current.TimeSampled < BucketTime)
+		{
+			return;
+		}
+
+		// the current bucket is complete, so start a new one, dropping the oldest if we're out of buckets
+		NewerTotal.Combine(current);
+		if (NumOlder + NumNewer == NumBuckets)
+		{
+			if (NumOlder == 0)
+			{
+				MoveNewerToOlder();
+			}
+			Oldest = (Oldest + 1) % NumBuckets;
+			NumOlder--;
+		}
+		NumNewer++;
+		Buckets[(Oldest + NumOlder + NumNewer - 1) % NumBuckets].Clear();
+	}
+
+	GAMEPADMOTION_API void SensorSlidingWindow::GetWindow(SensorMinMaxWindow& outWindow) const
+	{
+		SensorWindowBucket total = NewerTotal;
+		if (NumOlder > 0)
+		{
+			total.Combine(OlderTotals[Oldest]);
+		}
+		total.Combine(Buckets[(Oldest + NumOlder + NumNewer - 1) % NumBuckets]);
+
+		outWindow.NumSamples = total.NumSamples;
+		outWindow.TimeSampled = total.TimeSampled;
+		if (total.NumSamples == 0)
+		{
+			return;
+		}
+
+		const float inverseNumSamples = 1.f / total.NumSamples;
+		outWindow.MinGyro = total.MinGyro;
+		outWindow.MaxGyro = total.MaxGyro;
+		outWindow.MeanGyro = total.SumGyro * inverseNumSamples;
+		outWindow.MinAccel = total.MinAccel;
+		outWindow.MaxAccel = total.MaxAccel;
+		outWindow.MeanAccel = total.SumAccel * inverseNumSamples;
+		outWindow.SquaredDeviationGyro = total.SquaredDeviationGyro;
+		outWindow.SquaredDeviationAccel = total.SquaredDeviationAccel;
+	}
+
+	GAMEPADMOTION_API void SensorSlidingWindow::MoveNewerToOlder()
+	{
+		NumOlder += NumNewer;
+		NumNewer = 0;
+		RebuildTotals();
+	}
+
+	GAMEPADMOTION_API void SensorSlidingWindow::RebuildTotals()
+	{
+		// work out the combined totals again from the buckets themselves, in the same order AddSample combines them
+		if (NumOlder > 0)
+		{
+			const int newestOlder = (Oldest + NumOlder - 1) % NumBuckets;
+			OlderTotals[newestOlder] = Buckets[newestOlder];
+			for (int i = NumOlder - 2; i >= 0; i--)
+			{
+				const int index = (Oldest + i) % NumBuckets;
+				OlderTotals[index] = Buckets[index];
+				OlderTotals[index].Combine(OlderTotals[(index + 1) % NumBuckets]);
+			}
+		}
+
+		NewerTotal.Clear();
+		for (int i = 0; i < NumNewer - 1; i++)
+		{
+			NewerTotal.Combine(Buckets[(Oldest + NumOlder + i) % NumBuckets]);
+		}
+	}
+
+	GAMEPADMOTION_API AutoCalibration::AutoCalibration()
 	{
 		CalibrationData = nullptr;
 		MinMaxWindow.TimeSampled = 0.f;
 		TimeSteadyStillness = 0.f;
 	}
 
-	bool AutoCalibration::AddSampleStillness(const Vec& inGyro, const Vec& inAccel, Vec& inOutVecMask, float deltaTime)
+	GAMEPADMOTION_API bool AutoCalibration::AddSampleStillness(const Vec& inGyro, const Vec& inAccel, Vec& inOutVecMask, float deltaTime)
 	{
 		if (inGyro.x == 0.f && inGyro.y == 0.f && inGyro.z == 0.f &&
 			inAccel.x == 0.f && inAccel.y == 0.f && inAccel.z == 0.f)
@@ -690,41 +2267,66 @@ namespace GamepadMotionHelpers
 		}
 
 		// get settings
-		const int MinStillnessSamples = Settings->MinStillnessSamples;
-		const float MinStillnessTime = Settings->MinStillnessTime;
-		const float MaxStillnessError = Settings->MaxStillnessError;
-		const float StillnessSampleDeteriorationRate = Settings->StillnessSampleDeteriorationRate;
-		const float StillnessErrorClimbRate = Settings->StillnessErrorClimbRate;
-		const float StillnessErrorDropOnRecalibrate = Settings->StillnessErrorDropOnRecalibrate;
-		const float stillnessCalibrationEaseInTime = Settings->StillnessCalibrationEaseInTime;
-		const float stillnessCalibrationHalfTime = Settings->StillnessCalibrationHalfTime;
+		const GamepadMotionSettings& settings = Settings->GetSettings();
+		const int MinStillnessSamples = settings.MinStillnessSamples;
+		const float MinStillnessTime = settings.MinStillnessTime;
+		const float MaxStillnessError = settings.MaxStillnessError;
+		const float StillnessSampleDeteriorationRate = settings.StillnessSampleDeteriorationRate;
+		const float StillnessErrorClimbRate = settings.StillnessErrorClimbRate;
+		const float StillnessErrorDropOnRecalibrate = settings.StillnessErrorDropOnRecalibrate;
+		const float stillnessCalibrationEaseInTime = settings.StillnessCalibrationEaseInTime;
+		const float stillnessCalibrationInverseEaseInTime = Settings->StillnessCalibrationInverseEaseInTime;
+		const float stillnessCalibrationInverseHalfTime = Settings->StillnessCalibrationInverseHalfTime;
+		const float StillnessWindowTime = settings.StillnessWindowTime;
+		const bool slidingWindow = StillnessWindowTime > 0.f;
+		const bool noiseFloor = settings.StillnessDetection == NoiseFloorStillness;
+		// a sliding window never holds more than its own length
+		const float minStillnessTime = slidingWindow ? std::min(MinStillnessTime, StillnessWindowTime) : MinStillnessTime;
 
 		bool calibrated = false;
 		const Vec climbThisTick = Vec(StillnessSampleDeteriorationRate * deltaTime);
-		MinDeltaGyro += climbThisTick;
-		MinDeltaAccel += climbThisTick;
+		Vec& minDeltaGyro = noiseFloor ? NoiseFloorGyro : MinDeltaGyro;
+		Vec& minDeltaAccel = noiseFloor ? NoiseFloorAccel : MinDeltaAccel;
+		minDeltaGyro += climbThisTick;
+		minDeltaAccel += climbThisTick;
 
-		MinMaxWindow.AddSample(inGyro, inAccel, deltaTime);
+		if (slidingWindow)
+		{
+			SlidingWindow.AddSample(inGyro, inAccel, deltaTime, StillnessWindowTime);
+			SlidingWindow.GetWindow(MinMaxWindow);
+		}
+		else
+		{
+			MinMaxWindow.AddSample(inGyro, inAccel, deltaTime);
+		}
 
 		// get deltas
-		const Vec gyroDelta = MinMaxWindow.MaxGyro - MinMaxWindow.MinGyro;
-		const Vec accelDelta = MinMaxWindow.MaxAccel - MinMaxWindow.MinAccel;
+		const Vec gyroDelta = noiseFloor ? MinMaxWindow.GetGyroStandardDeviation() : MinMaxWindow.MaxGyro - MinMaxWindow.MinGyro;
+		const Vec accelDelta = noiseFloor ? MinMaxWindow.GetAccelStandardDeviation() : MinMaxWindow.MaxAccel - MinMaxWindow.MinAccel;
+
+		if (MinMaxWindow.NumSamples >= MinStillnessSamples && MinMaxWindow.TimeSampled >= minStillnessTime)
+		{
+			minDeltaGyro = minDeltaGyro.Min(gyroDelta);
+			minDeltaAccel = minDeltaAccel.Min(accelDelta);
+		}
 
-		if (MinMaxWindow.NumSamples >= MinStillnessSamples && MinMaxWindow.TimeSampled >= MinStillnessTime)
+		// a standard deviation measured from n samples is itself only accurate to about 1 / sqrt(2n) of it, so allow
+		// for three times that on top of the noise floor. Otherwise ordinary noise would keep nudging it just over
+		float threshold = RecalibrateThreshold;
+		if (noiseFloor && MinMaxWindow.NumSamples > 0)
 		{
-			MinDeltaGyro = MinDeltaGyro.Min(gyroDelta);
-			MinDeltaAccel = MinDeltaAccel.Min(accelDelta);
+			threshold += 3.f / sqrtf(2.f * MinMaxWindow.NumSamples);
 		}
 
 		// check that all inputs are below appropriate thresholds to be considered "still"
-		if (gyroDelta.x <= MinDeltaGyro.x * RecalibrateThreshold &&
-			gyroDelta.y <= MinDeltaGyro.y * RecalibrateThreshold &&
-			gyroDelta.z <= MinDeltaGyro.z * RecalibrateThreshold &&
-			accelDelta.x <= MinDeltaAccel.x * RecalibrateThreshold &&
-			accelDelta.y <= MinDeltaAccel.y * RecalibrateThreshold &&
-			accelDelta.z <= MinDeltaAccel.z * RecalibrateThreshold)
-		{
-			if (CalibrationData != nullptr && MinMaxWindow.NumSamples >= MinStillnessSamples && MinMaxWindow.TimeSampled >= MinStillnessTime)
+		if (gyroDelta.x <= minDeltaGyro.x * threshold &&
+			gyroDelta.y <= minDeltaGyro.y * threshold &&
+			gyroDelta.z <= minDeltaGyro.z * threshold &&
+			accelDelta.x <= minDeltaAccel.x * threshold &&
+			accelDelta.y <= minDeltaAccel.y * threshold &&
+			accelDelta.z <= minDeltaAccel.z * threshold)
+		{
+			if (CalibrationData != nullptr && MinMaxWindow.NumSamples >= MinStillnessSamples && MinMaxWindow.TimeSampled >= minStillnessTime)
 			{
 				/*if (TimeSteadyStillness == 0.f)
 				{
@@ -732,12 +2334,12 @@ namespace GamepadMotionHelpers
 				}/**/
 
 				TimeSteadyStillness = std::min(TimeSteadyStillness + deltaTime, stillnessCalibrationEaseInTime);
-				const float calibrationEaseIn = stillnessCalibrationEaseInTime <= 0.f ? 1.f : TimeSteadyStillness / stillnessCalibrationEaseInTime;
+				const float calibrationEaseIn = stillnessCalibrationInverseEaseInTime <= 0.f ? 1.f : TimeSteadyStillness * stillnessCalibrationInverseEaseInTime;
 
 				const Vec calibratedGyro = MinMaxWindow.GetMidGyro();
 
 				const Vec oldGyroBias = Vec(CalibrationData->X, CalibrationData->Y, CalibrationData->Z) / std::max((float)CalibrationData->NumSamples, 1.f);
-				const float stillnessLerpFactor = stillnessCalibrationHalfTime <= 0.f ? 0.f : exp2f(-calibrationEaseIn * deltaTime / stillnessCalibrationHalfTime);
+				const float stillnessLerpFactor = stillnessCalibrationInverseHalfTime <= 0.f ? 0.f : StillnessLerpExp2.Get(-calibrationEaseIn * deltaTime * stillnessCalibrationInverseHalfTime);
 				const Vec newGyroBias = calibratedGyro.Lerp(oldGyroBias, stillnessLerpFactor);
 
 				CalibrationData->X = (inOutVecMask.x != 0) ? newGyroBias.x : oldGyroBias.x;
@@ -761,23 +2363,31 @@ namespace GamepadMotionHelpers
 			if (RecalibrateThreshold < 1.f) RecalibrateThreshold = 1.f;
 
 			TimeSteadyStillness = 0.f;
-			MinMaxWindow.Reset(0.f);
+			// a sliding window doesn't need to start again. The movement will pass out of it on its own
+			if (!slidingWindow)
+			{
+				MinMaxWindow.Reset(0.f);
+			}
 		}
 		else
 		{
 			RecalibrateThreshold = std::min(RecalibrateThreshold + StillnessErrorClimbRate * deltaTime, MaxStillnessError);
-			MinMaxWindow.Reset(0.f);
+			if (!slidingWindow)
+			{
+				MinMaxWindow.Reset(0.f);
+			}
 		}
 
 		return calibrated;
 	}
 
-	void AutoCalibration::NoSampleStillness()
+	GAMEPADMOTION_API void AutoCalibration::NoSampleStillness()
 	{
 		MinMaxWindow.Reset(0.f);
+		SlidingWindow.Reset();
 	}
 
-	bool AutoCalibration::AddSampleSensorFusion(const Vec& inGyro, const Vec& inAccel, Vec& inOutVecMask, float deltaTime)
+	GAMEPADMOTION_API bool AutoCalibration::AddSampleSensorFusion(const Vec& inGyro, const Vec& inAccel, Vec& inOutVecMask, float deltaTime)
 	{
 		if (deltaTime <= 0.f)
 		{
@@ -821,17 +2431,19 @@ namespace GamepadMotionHelpers
 		}
 
 		// get settings
-		const float SensorFusionCalibrationSmoothingStrength = Settings->SensorFusionCalibrationSmoothingStrength;
-		const float SensorFusionAngularAccelerationThreshold = Settings->SensorFusionAngularAccelerationThreshold;
-		const float sensorFusionCalibrationEaseInTime = Settings->SensorFusionCalibrationEaseInTime;
-		const float sensorFusionCalibrationHalfTime = Settings->SensorFusionCalibrationHalfTime;
+		const GamepadMotionSettings& settings = Settings->GetSettings();
+		const float SensorFusionCalibrationSmoothingStrength = settings.SensorFusionCalibrationSmoothingStrength;
+		const float SensorFusionAngularAccelerationThreshold = settings.SensorFusionAngularAccelerationThreshold;
+		const float sensorFusionCalibrationEaseInTime = settings.SensorFusionCalibrationEaseInTime;
+		const float sensorFusionCalibrationInverseEaseInTime = Settings->SensorFusionCalibrationInverseEaseInTime;
+		const float sensorFusionCalibrationInverseHalfTime = Settings->SensorFusionCalibrationInverseHalfTime;
 
 		deltaTime += SensorFusionSkippedTime;
 		SensorFusionSkippedTime = 0.f;
 		bool calibrated = false;
 		
 		// framerate independent lerp smoothing: https://www.gamasutra.com/blogs/ScottLembcke/20180404/316046/Improved_Lerp_Smoothing.php
-		const float smoothingLerpFactor = exp2f(-SensorFusionCalibrationSmoothingStrength * deltaTime);
+		const float smoothingLerpFactor = SensorFusionSmoothingExp2.Get(-SensorFusionCalibrationSmoothingStrength * deltaTime);
 		// velocity from smoothed accel matches better if we also smooth gyro
 		const Vec previousGyro = SmoothedAngularVelocityGyro;
 		SmoothedAngularVelocityGyro = inGyro.Lerp(SmoothedAngularVelocityGyro, smoothingLerpFactor); // smooth what remains
@@ -843,7 +2455,7 @@ namespace GamepadMotionHelpers
 		Vec angularVelocity = thisNormal.Cross(previousNormal);
 		const float crossLength = angularVelocity.Length();
 		const float thisDotPrev = std::clamp(thisNormal.Dot(previousNormal), -1.f, 1.f);
-		const float angleChange = acosf(thisDotPrev) * 180.0f / (float)M_PI;
+		const float angleChange = Acos(thisDotPrev) * 180.0f / (float)M_PI;
 		const float anglePerSecond = angleChange / deltaTime;
 		if (crossLength > 0.f)
 		{
@@ -869,10 +2481,10 @@ namespace GamepadMotionHelpers
 			}/**/
 
 			TimeSteadySensorFusion = std::min(TimeSteadySensorFusion + deltaTime, sensorFusionCalibrationEaseInTime);
-			const float calibrationEaseIn = sensorFusionCalibrationEaseInTime <= 0.f ? 1.f : TimeSteadySensorFusion / sensorFusionCalibrationEaseInTime;
+			const float calibrationEaseIn = sensorFusionCalibrationInverseEaseInTime <= 0.f ? 1.f : TimeSteadySensorFusion * sensorFusionCalibrationInverseEaseInTime;
 			const Vec oldGyroBias = Vec(CalibrationData->X, CalibrationData->Y, CalibrationData->Z) / std::max((float)CalibrationData->NumSamples, 1.f);
 			// recalibrate over time proportional to the difference between the calculated bias and the current assumed bias
-			const float sensorFusionLerpFactor = sensorFusionCalibrationHalfTime <= 0.f ? 0.f : exp2f(-calibrationEaseIn * deltaTime / sensorFusionCalibrationHalfTime);
+			const float sensorFusionLerpFactor = sensorFusionCalibrationInverseHalfTime <= 0.f ? 0.f : SensorFusionLerpExp2.Get(-calibrationEaseIn * deltaTime * sensorFusionCalibrationInverseHalfTime);
 			Vec newGyroBias = (SmoothedAngularVelocityGyro - SmoothedAngularVelocityAccel).Lerp(oldGyroBias, sensorFusionLerpFactor);
 			// don't change bias in axes that can't be affected by the gravity direction
 			Vec axisCalibrationStrength = thisNormal.Abs();
@@ -927,7 +2539,7 @@ namespace GamepadMotionHelpers
 		return calibrated;
 	}
 
-	void AutoCalibration::NoSampleSensorFusion()
+	GAMEPADMOTION_API void AutoCalibration::NoSampleSensorFusion()
 	{
 		TimeSteadySensorFusion = 0.f;
 		SensorFusionSkippedTime = 0.f;
@@ -937,114 +2549,2272 @@ namespace GamepadMotionHelpers
 		SmoothedAngularVelocityAccel = GamepadMotionHelpers::Vec();
 	}
 
-	void AutoCalibration::SetCalibrationData(GyroCalibration* calibrationData)
+	GAMEPADMOTION_API void AutoCalibration::SetCalibrationData(GyroCalibration* calibrationData)
 	{
 		CalibrationData = calibrationData;
 	}
 
-	void AutoCalibration::SetSettings(GamepadMotionSettings* settings)
+	GAMEPADMOTION_API void AutoCalibration::SetSettings(const GamepadMotionSettingsProfile* settings)
 	{
 		Settings = settings;
 	}
 
-} // namespace GamepadMotionHelpers
-
-GamepadMotion::GamepadMotion()
-{
-	IsCalibrating = false;
-	CurrentCalibrationMode = GamepadMotionHelpers::CalibrationMode::Manual;
-	Reset();
-	AutoCalibration.SetCalibrationData(&GyroCalibration);
-	AutoCalibration.SetSettings(&Settings);
-	Motion.SetSettings(&Settings);
-}
-
-void GamepadMotion::Reset()
-{
-	GyroCalibration = {};
-	Gyro = {};
-	RawAccel = {};
-	Settings = GamepadMotionSettings();
-	Motion.Reset();
-}
-
-void GamepadMotion::ProcessMotion(float gyroX, float gyroY, float gyroZ,
-	float accelX, float accelY, float accelZ, float deltaTime)
-{
-	float accelMagnitude = sqrtf(accelX * accelX + accelY * accelY + accelZ * accelZ);
+	GAMEPADMOTION_API float AutoCalibration::GetRecalibrateThreshold() const
+	{
+		return RecalibrateThreshold;
+	}
 
-	if (IsCalibrating)
+	GAMEPADMOTION_API float AutoCalibration::GetTimeSteadyStillness() const
 	{
-		// manual calibration
-		PushSensorSamples(gyroX, gyroY, gyroZ, accelMagnitude);
-		AutoCalibration.NoSampleSensorFusion();
-		AutoCalibration.NoSampleStillness();
+		return TimeSteadyStillness;
 	}
-	else
+
+	GAMEPADMOTION_API void AutoCalibration::SaveSnapshot(AutoCalibrationSnapshot& outSnapshot) const
 	{
-		// we only calibrate in axes that haven't already been calibrated by a previous step. To start, we're calibrating in All axes.
-		GamepadMotionHelpers::Vec vecMask = GamepadMotionHelpers::Vec(1.f);
-		
-		if (CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::SensorFusion)
+		StoreVec(MinMaxWindow.MinGyro, outSnapshot.MinGyro);
+		StoreVec(MinMaxWindow.MaxGyro, outSnapshot.MaxGyro);
+		StoreVec(MinMaxWindow.MeanGyro, outSnapshot.MeanGyro);
+		StoreVec(MinMaxWindow.MinAccel, outSnapshot.MinAccel);
+		StoreVec(MinMaxWindow.MaxAccel, outSnapshot.MaxAccel);
+		StoreVec(MinMaxWindow.MeanAccel, outSnapshot.MeanAccel);
+		StoreVec(MinMaxWindow.SquaredDeviationGyro, outSnapshot.SquaredDeviationGyro);
+		StoreVec(MinMaxWindow.SquaredDeviationAccel, outSnapshot.SquaredDeviationAccel);
+		outSnapshot.WindowNumSamples = MinMaxWindow.NumSamples;
+		outSnapshot.WindowTimeSampled = MinMaxWindow.TimeSampled;
+		StoreVec(SmoothedAngularVelocityGyro, outSnapshot.SmoothedAngularVelocityGyro);
+		StoreVec(SmoothedAngularVelocityAccel, outSnapshot.SmoothedAngularVelocityAccel);
+		StoreVec(SmoothedPreviousAccel, outSnapshot.SmoothedPreviousAccel);
+		StoreVec(PreviousAccel, outSnapshot.PreviousAccel);
+		StoreVec(MinDeltaGyro, outSnapshot.MinDeltaGyro);
+		StoreVec(MinDeltaAccel, outSnapshot.MinDeltaAccel);
+		StoreVec(NoiseFloorGyro, outSnapshot.NoiseFloorGyro);
+		StoreVec(NoiseFloorAccel, outSnapshot.NoiseFloorAccel);
+		outSnapshot.RecalibrateThreshold = RecalibrateThreshold;
+		outSnapshot.SensorFusionSkippedTime = SensorFusionSkippedTime;
+		outSnapshot.TimeSteadySensorFusion = TimeSteadySensorFusion;
+		outSnapshot.TimeSteadyStillness = TimeSteadyStillness;
+		for (int i = 0; i < SensorSlidingWindow::NumBuckets; i++)
 		{
-			AutoCalibration.AddSampleSensorFusion(GamepadMotionHelpers::Vec(gyroX, gyroY, gyroZ), GamepadMotionHelpers::Vec(accelX, accelY, accelZ), vecMask, deltaTime);
+			const SensorWindowBucket& bucket = SlidingWindow.Buckets[i];
+			SensorWindowBucketSnapshot& bucketSnapshot = outSnapshot.SlidingWindowBuckets[i];
+			StoreVec(bucket.MinGyro, bucketSnapshot.MinGyro);
+			StoreVec(bucket.MaxGyro, bucketSnapshot.MaxGyro);
+			StoreVec(bucket.SumGyro, bucketSnapshot.SumGyro);
+			StoreVec(bucket.MinAccel, bucketSnapshot.MinAccel);
+			StoreVec(bucket.MaxAccel, bucketSnapshot.MaxAccel);
+			StoreVec(bucket.SumAccel, bucketSnapshot.SumAccel);
+			StoreVec(bucket.SquaredDeviationGyro, bucketSnapshot.SquaredDeviationGyro);
+			StoreVec(bucket.SquaredDeviationAccel, bucketSnapshot.SquaredDeviationAccel);
+			bucketSnapshot.NumSamples = bucket.NumSamples;
+			bucketSnapshot.TimeSampled = bucket.TimeSampled;
+		}
+		outSnapshot.SlidingWindowOldest = SlidingWindow.Oldest;
+		outSnapshot.SlidingWindowNumOlder = SlidingWindow.NumOlder;
+		outSnapshot.SlidingWindowNumNewer = SlidingWindow.NumNewer;
+		outSnapshot.SlidingWindowBucketTime = SlidingWindow.BucketTime;
+	}
+
+	GAMEPADMOTION_API void AutoCalibration::LoadSnapshot(const AutoCalibrationSnapshot& snapshot)
+	{
+		MinMaxWindow.MinGyro = LoadVec(snapshot.MinGyro);
+		MinMaxWindow.MaxGyro = LoadVec(snapshot.MaxGyro);
+		MinMaxWindow.MeanGyro = LoadVec(snapshot.MeanGyro);
+		MinMaxWindow.MinAccel = LoadVec(snapshot.MinAccel);
+		MinMaxWindow.MaxAccel = LoadVec(snapshot.MaxAccel);
+		MinMaxWindow.MeanAccel = LoadVec(snapshot.MeanAccel);
+		MinMaxWindow.SquaredDeviationGyro = LoadVec(snapshot.SquaredDeviationGyro);
+		MinMaxWindow.SquaredDeviationAccel = LoadVec(snapshot.SquaredDeviationAccel);
+		MinMaxWindow.NumSamples = snapshot.WindowNumSamples;
+		MinMaxWindow.TimeSampled = snapshot.WindowTimeSampled;
+		SmoothedAngularVelocityGyro = LoadVec(snapshot.SmoothedAngularVelocityGyro);
+		SmoothedAngularVelocityAccel = LoadVec(snapshot.SmoothedAngularVelocityAccel);
+		SmoothedPreviousAccel = LoadVec(snapshot.SmoothedPreviousAccel);
+		PreviousAccel = LoadVec(snapshot.PreviousAccel);
+		MinDeltaGyro = LoadVec(snapshot.MinDeltaGyro);
+		MinDeltaAccel = LoadVec(snapshot.MinDeltaAccel);
+		NoiseFloorGyro = LoadVec(snapshot.NoiseFloorGyro);
+		NoiseFloorAccel = LoadVec(snapshot.NoiseFloorAccel);
+		RecalibrateThreshold = snapshot.RecalibrateThreshold;
+		SensorFusionSkippedTime = snapshot.SensorFusionSkippedTime;
+		TimeSteadySensorFusion = snapshot.TimeSteadySensorFusion;
+		TimeSteadyStillness = snapshot.TimeSteadyStillness;
+		for (int i = 0; i < SensorSlidingWindow::NumBuckets; i++)
+		{
+			SensorWindowBucket& bucket = SlidingWindow.Buckets[i];
+			const SensorWindowBucketSnapshot& bucketSnapshot = snapshot.SlidingWindowBuckets[i];
+			bucket.MinGyro = LoadVec(bucketSnapshot.MinGyro);
+			bucket.MaxGyro = LoadVec(bucketSnapshot.MaxGyro);
+			bucket.SumGyro = LoadVec(bucketSnapshot.SumGyro);
+			bucket.MinAccel = LoadVec(bucketSnapshot.MinAccel);
+			bucket.MaxAccel = LoadVec(bucketSnapshot.MaxAccel);
+			bucket.SumAccel = LoadVec(bucketSnapshot.SumAccel);
+			bucket.SquaredDeviationGyro = LoadVec(bucketSnapshot.SquaredDeviationGyro);
+			bucket.SquaredDeviationAccel = LoadVec(bucketSnapshot.SquaredDeviationAccel);
+			bucket.NumSamples = bucketSnapshot.NumSamples;
+			bucket.TimeSampled = bucketSnapshot.TimeSampled;
+		}
+		SlidingWindow.Oldest = snapshot.SlidingWindowOldest;
+		SlidingWindow.NumOlder = snapshot.SlidingWindowNumOlder;
+		SlidingWindow.NumNewer = snapshot.SlidingWindowNumNewer;
+		SlidingWindow.BucketTime = snapshot.SlidingWindowBucketTime;
+		SlidingWindow.RebuildTotals();
+	}
+
+	GAMEPADMOTION_API bool AutoCalibration::IsValidSnapshot(const AutoCalibrationSnapshot& snapshot)
+	{
+		// BucketTime is 0 until the window is first used. The comparisons are false for NaN too
+		const float bucketTime = snapshot.SlidingWindowBucketTime;
+		if (snapshot.SlidingWindowOldest < 0 || snapshot.SlidingWindowOldest >= SensorSlidingWindow::NumBuckets ||
+			snapshot.SlidingWindowNumOlder < 0 || snapshot.SlidingWindowNumNewer < 1 ||
+			snapshot.SlidingWindowNumOlder + snapshot.SlidingWindowNumNewer > SensorSlidingWindow::NumBuckets ||
+			!(bucketTime >= 0.f && bucketTime <= FLT_MAX))
+		{
+			return false;
+		}
+
+		for (int i = 0; i < SensorSlidingWindow::NumBuckets; i++)
+		{
+			if (snapshot.SlidingWindowBuckets[i].NumSamples < 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	GAMEPADMOTION_API GyroAccumulator::GyroAccumulator()
+	{
+		Reset();
+	}
+
+	GAMEPADMOTION_API void GyroAccumulator::Reset()
+	{
+		AngleX = 0.0;
+		AngleY = 0.0;
+		AngleZ = 0.0;
+		Rotation.Set(1.f, 0.f, 0.f, 0.f);
+		Time = 0.0;
+		NumSamples = 0;
+	}
+
+	GAMEPADMOTION_API void GyroAccumulator::AddSample(const Vec& inGyro, const Quat& inRotation, float deltaTime)
+	{
+		AngleX += (double)(inGyro.x * deltaTime);
+		AngleY += (double)(inGyro.y * deltaTime);
+		AngleZ += (double)(inGyro.z * deltaTime);
+		Rotation *= inRotation;
+		Rotation.Normalize();
+		Time += (double)deltaTime;
+		NumSamples++;
+	}
+
+	GAMEPADMOTION_API void GyroAccumulator::GetTotals(GamepadMotionDelta& outDelta) const
+	{
+		outDelta.GyroAngle[0] = (float)AngleX;
+		outDelta.GyroAngle[1] = (float)AngleY;
+		outDelta.GyroAngle[2] = (float)AngleZ;
+		outDelta.Rotation[0] = Rotation.w;
+		outDelta.Rotation[1] = Rotation.x;
+		outDelta.Rotation[2] = Rotation.y;
+		outDelta.Rotation[3] = Rotation.z;
+		outDelta.Time = (float)Time;
+		outDelta.NumSamples = (int)NumSamples;
+	}
+
+	GAMEPADMOTION_API GyroHistory::GyroHistory()
+	{
+		Reset();
+	}
+
+	GAMEPADMOTION_API void GyroHistory::Reset()
+	{
+		Newest = 0;
+		NumSamples = 0;
+	}
+
+	GAMEPADMOTION_API void GyroHistory::AddSample(const Vec& inGyro, float deltaTime)
+	{
+		Newest = (Newest + 1) % Size;
+		Entries[Newest].Gyro = inGyro;
+		Entries[Newest].DeltaTime = deltaTime;
+		NumSamples = std::min(NumSamples + 1, Size);
+	}
+
+	GAMEPADMOTION_API Vec GyroHistory::GetAngularAcceleration() const
+	{
+		// sample times relative to the newest, going back until samples get too old
+		float times[Size];
+		int numSamples = 0;
+		float age = 0.f;
+		for (int sample = 0; sample < NumSamples; sample++)
+		{
+			const int index = (Newest - sample + Size) % Size;
+			if (sample >= 2 && age > MaxAge)
+			{
+				break;
+			}
+			times[sample] = -age;
+			age += Entries[index].DeltaTime;
+			numSamples++;
+		}
+
+		if (numSamples < 2)
+		{
+			return Vec();
+		}
+
+		float meanTime = 0.f;
+		Vec meanGyro;
+		for (int sample = 0; sample < numSamples; sample++)
+		{
+			meanTime += times[sample];
+			meanGyro += Entries[(Newest - sample + Size) % Size].Gyro;
+		}
+		const float inverseNumSamples = 1.f / numSamples;
+		meanTime *= inverseNumSamples;
+		meanGyro *= inverseNumSamples;
+
+		float timeVariance = 0.f;
+		Vec covariance;
+		for (int sample = 0; sample < numSamples; sample++)
+		{
+			const float timeOffset = times[sample] - meanTime;
+			timeVariance += timeOffset * timeOffset;
+			covariance += (Entries[(Newest - sample + Size) % Size].Gyro - meanGyro) * timeOffset;
+		}
+
+		if (timeVariance <= 0.f)
+		{
+			return Vec();
+		}
+		return covariance / timeVariance;
+	}
+
+	GAMEPADMOTION_API TimestampTracker::TimestampTracker()
+	{
+		SetFormat(1000000.0, 64, 0.f);
+		Reset();
+	}
+
+	GAMEPADMOTION_API void TimestampTracker::SetFormat(double ticksPerSecond, int numBits, float smoothingHalfTime)
+	{
+		SecondsPerTick = ticksPerSecond > 0.0 ? 1.0 / ticksPerSecond : 1.0;
+		Mask = (numBits <= 0 || numBits >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << numBits) - 1;
+		SmoothingHalfTime = smoothingHalfTime;
+		Reset();
+	}
+
+	GAMEPADMOTION_API void TimestampTracker::Reset()
+	{
+		LastTimestamp = 0;
+		HasTimestamp = false;
+		SmoothedDeltaTime = 0.f;
+		PendingTime = 0.f;
+	}
+
+	GAMEPADMOTION_API float TimestampTracker::Update(uint64_t timestamp)
+	{
+		timestamp &= Mask;
+		if (!HasTimestamp)
+		{
+			LastTimestamp = timestamp;
+			HasTimestamp = true;
+			return -1.f;
+		}
+
+		// unsigned subtraction then masking takes care of wraparound
+		const uint64_t ticks = (timestamp - LastTimestamp) & Mask;
+		if (ticks == 0)
+		{
+			return -1.f;
+		}
+		LastTimestamp = timestamp;
+
+		const float measuredDeltaTime = (float)((double)ticks * SecondsPerTick);
+		if (measuredDeltaTime > MaxGap)
+		{
+			// don't spread this sample's motion over the whole gap. Going backwards in time ends up here too
+			PendingTime = 0.f;
+			return SmoothedDeltaTime > 0.f ? SmoothedDeltaTime : -1.f;
+		}
+
+		if (SmoothingHalfTime <= 0.f || SmoothedDeltaTime <= 0.f)
+		{
+			SmoothedDeltaTime = measuredDeltaTime;
+			if (SmoothingHalfTime <= 0.f)
+			{
+				return measuredDeltaTime;
+			}
 		}
 		else
 		{
-			AutoCalibration.NoSampleSensorFusion();
+			const float smoothingFactor = SmoothingExp2.Get(-measuredDeltaTime / SmoothingHalfTime);
+			SmoothedDeltaTime = measuredDeltaTime + (SmoothedDeltaTime - measuredDeltaTime) * smoothingFactor;
+		}
+
+		// use the smoothed deltaTime, but never get ahead of the timestamps or fall more than a sample behind them
+		PendingTime += measuredDeltaTime;
+		const float deltaTime = std::min(std::max(SmoothedDeltaTime, PendingTime - SmoothedDeltaTime), PendingTime);
+		PendingTime -= deltaTime;
+		return deltaTime;
+	}
+
+	GAMEPADMOTION_API TemperatureBiasFit::TemperatureBiasFit()
+	{
+		Reset();
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::Reset()
+	{
+		Temperature = 0.f;
+		HasTemperature = false;
+		ReferenceTemperature = 0.f;
+		SettleTimeLeft = SettleTime;
+		SumWeight = 0.f;
+		SumTemperature = 0.f;
+		SumTemperatureSquared = 0.f;
+		SumBias.Set(0.f, 0.f, 0.f);
+		SumTemperatureBias.Set(0.f, 0.f, 0.f);
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::SetTemperature(float temperature)
+	{
+		if (!HasTemperature)
+		{
+			ReferenceTemperature = temperature;
+			HasTemperature = true;
+		}
+		Temperature = temperature;
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::Unsettle()
+	{
+		SettleTimeLeft = SettleTime;
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::AddSample(const Vec& inBias, float weight)
+	{
+		if (SettleTimeLeft > 0.f)
+		{
+			SettleTimeLeft -= weight;
+			return;
+		}
+
+		const float temperature = Temperature - ReferenceTemperature;
+		SumWeight += weight;
+		SumTemperature += temperature * weight;
+		SumTemperatureSquared += temperature * temperature * weight;
+		SumBias += inBias * weight;
+		SumTemperatureBias += inBias * (temperature * weight);
+
+		if (SumWeight > MaxWeight)
+		{
+			const float fade = MaxWeight / SumWeight;
+			SumWeight = MaxWeight;
+			SumTemperature *= fade;
+			SumTemperatureSquared *= fade;
+			SumBias *= fade;
+			SumTemperatureBias *= fade;
+		}
+	}
+
+	GAMEPADMOTION_API bool TemperatureBiasFit::GetSlope(Vec& outSlope) const
+	{
+		if (SumWeight <= 0.f)
+		{
+			return false;
+		}
+
+		const float inverseWeight = 1.f / SumWeight;
+		const float meanTemperature = SumTemperature * inverseWeight;
+		const float temperatureVariance = SumTemperatureSquared * inverseWeight - meanTemperature * meanTemperature;
+		if (temperatureVariance < MinTemperatureSpread * MinTemperatureSpread)
+		{
+			return false;
+		}
+
+		const Vec covariance = SumTemperatureBias * inverseWeight - SumBias * (inverseWeight * meanTemperature);
+		outSlope = covariance / temperatureVariance;
+		return true;
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::SaveSnapshot(TemperatureBiasSnapshot& outSnapshot) const
+	{
+		outSnapshot.Temperature = Temperature;
+		outSnapshot.HasTemperature = HasTemperature ? 1 : 0;
+		outSnapshot.ReferenceTemperature = ReferenceTemperature;
+		outSnapshot.SettleTimeLeft = SettleTimeLeft;
+		outSnapshot.SumWeight = SumWeight;
+		outSnapshot.SumTemperature = SumTemperature;
+		outSnapshot.SumTemperatureSquared = SumTemperatureSquared;
+		StoreVec(SumBias, outSnapshot.SumBias);
+		StoreVec(SumTemperatureBias, outSnapshot.SumTemperatureBias);
+	}
+
+	GAMEPADMOTION_API void TemperatureBiasFit::LoadSnapshot(const TemperatureBiasSnapshot& snapshot)
+	{
+		Temperature = snapshot.Temperature;
+		HasTemperature = snapshot.HasTemperature != 0;
+		ReferenceTemperature = snapshot.ReferenceTemperature;
+		SettleTimeLeft = snapshot.SettleTimeLeft;
+		SumWeight = snapshot.SumWeight;
+		SumTemperature = snapshot.SumTemperature;
+		SumTemperatureSquared = snapshot.SumTemperatureSquared;
+		SumBias = LoadVec(snapshot.SumBias);
+		SumTemperatureBias = LoadVec(snapshot.SumTemperatureBias);
+	}
+
+	// fills outDelta with the motion between two sets of totals
+	inline void GetGyroDelta(const double* firstAngle, const float* firstRotation, double firstTime, unsigned int firstSamples,
+		const double* secondAngle, const float* secondRotation, double secondTime, unsigned int secondSamples, GamepadMotionDelta& outDelta)
+	{
+		outDelta.GyroAngle[0] = (float)(secondAngle[0] - firstAngle[0]);
+		outDelta.GyroAngle[1] = (float)(secondAngle[1] - firstAngle[1]);
+		outDelta.GyroAngle[2] = (float)(secondAngle[2] - firstAngle[2]);
+		// the rotation from first to second is first^-1 * second, since these are local rotations
+		const Quat rotation = Quat(firstRotation[0], firstRotation[1], firstRotation[2], firstRotation[3]).Inverse() *
+			Quat(secondRotation[0], secondRotation[1], secondRotation[2], secondRotation[3]);
+		outDelta.Rotation[0] = rotation.w;
+		outDelta.Rotation[1] = rotation.x;
+		outDelta.Rotation[2] = rotation.y;
+		outDelta.Rotation[3] = rotation.z;
+		outDelta.Time = (float)(secondTime - firstTime);
+		outDelta.NumSamples = (int)(secondSamples - firstSamples);
+	}
+#endif // GAMEPADMOTION_DEFINITIONS
+
+	template<bool Calibrating, bool SensorFusion, bool Stillness, typename Owner>
+	void MotionStep::Process(Owner& owner, float gyroX, float gyroY, float gyroZ,
+		float accelX, float accelY, float accelZ, float deltaTime, const float* magnetometer)
+	{
+		GAMEPADMOTION_STAT(uint64_t statTime = GAMEPADMOTION_INSTRUMENTATION_TIMER());
+		bool wasStill = false;
+		bool wasGravitySteady = false;
+		if constexpr (Owner::HasFullState)
+		{
+			GAMEPADMOTION_STAT(owner.Stats.NumSamples++);
+			wasStill = owner.AutoCalibration.GetTimeSteadyStillness() > 0.f;
+			wasGravitySteady = owner.Motion.TimeCorrecting > 0.f;
+		}
+		bool calibrationChanged = Calibrating;
+
+		float accelMagnitude = sqrtf(accelX * accelX + accelY * accelY + accelZ * accelZ);
+
+		if constexpr (Calibrating)
+		{
+			// manual calibration
+			owner.PushSensorSamples(gyroX, gyroY, gyroZ, accelMagnitude);
+			if constexpr (Owner::HasAutoCalibration)
+			{
+				owner.AutoCalibration.NoSampleSensorFusion();
+				owner.AutoCalibration.NoSampleStillness();
+			}
+			if constexpr (Owner::HasFullState)
+			{
+				GAMEPADMOTION_STAT(owner.Stats.ManualCalibrationTime += StatLap(statTime));
+			}
+		}
+		else if constexpr (Owner::HasAutoCalibration)
+		{
+			// we only calibrate in axes that haven't already been calibrated by a previous step. To start, we're calibrating in All axes.
+			Vec vecMask = Vec(1.f);
+
+			if constexpr (SensorFusion)
+			{
+				const bool calibrated = owner.AutoCalibration.AddSampleSensorFusion(Vec(gyroX, gyroY, gyroZ), Vec(accelX, accelY, accelZ), vecMask, deltaTime);
+				calibrationChanged |= calibrated;
+				if constexpr (Owner::HasFullState)
+				{
+					GAMEPADMOTION_STAT(owner.Stats.SensorFusionCalibrations += calibrated ? 1 : 0);
+				}
+			}
+			else
+			{
+				owner.AutoCalibration.NoSampleSensorFusion();
+			}
+			if constexpr (Owner::HasFullState)
+			{
+				GAMEPADMOTION_STAT(owner.Stats.SensorFusionTime += StatLap(statTime));
+			}
+
+			if constexpr (Stillness)
+			{
+				const bool calibrated = owner.AutoCalibration.AddSampleStillness(Vec(gyroX, gyroY, gyroZ), Vec(accelX, accelY, accelZ), vecMask, deltaTime);
+				calibrationChanged |= calibrated;
+				if constexpr (Owner::HasFullState)
+				{
+					GAMEPADMOTION_STAT(owner.Stats.StillnessCalibrations += calibrated ? 1 : 0);
+				}
+			}
+			else
+			{
+				owner.AutoCalibration.NoSampleStillness();
+			}
+			if constexpr (Owner::HasFullState)
+			{
+				GAMEPADMOTION_STAT(owner.Stats.StillnessTime += StatLap(statTime));
+			}
+		}
+
+		float gyroOffsetX, gyroOffsetY, gyroOffsetZ;
+		owner.GetCalibratedSensor(gyroOffsetX, gyroOffsetY, gyroOffsetZ, accelMagnitude);
+
+		if constexpr (Owner::HasFullState)
+		{
+			if (!Calibrating && calibrationChanged && owner.TemperatureBias.HasTemperature)
+			{
+				owner.TemperatureBias.AddSample(Vec(gyroOffsetX, gyroOffsetY, gyroOffsetZ), deltaTime);
+			}
+		}
+
+		gyroX -= gyroOffsetX;
+		gyroY -= gyroOffsetY;
+		gyroZ -= gyroOffsetZ;
+
+		if constexpr (Owner::HasOrientation)
+		{
+			owner.Motion.template Update<Owner::HasProcessedAcceleration>(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, accelMagnitude, deltaTime, magnetometer);
+			if constexpr (Owner::HasFullState)
+			{
+				GAMEPADMOTION_STAT(owner.Stats.MotionUpdateTime += StatLap(statTime));
+			}
+		}
+
+		owner.Gyro.x = gyroX;
+		owner.Gyro.y = gyroY;
+		owner.Gyro.z = gyroZ;
+
+		if constexpr (Owner::HasFullState)
+		{
+			const bool still = owner.AutoCalibration.GetTimeSteadyStillness() > 0.f;
+			const bool gravitySteady = owner.Motion.TimeCorrecting > 0.f;
+
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+			owner.Stats.StillnessEntered += (!wasStill && still) ? 1 : 0;
+			owner.Stats.StillnessExited += (wasStill && !still) ? 1 : 0;
+			const float recalibrateThreshold = owner.AutoCalibration.GetRecalibrateThreshold();
+			owner.Stats.RecalibrateThresholdChanges += recalibrateThreshold != owner.Stats.RecalibrateThreshold ? 1 : 0;
+			owner.Stats.RecalibrateThreshold = recalibrateThreshold;
+			if (gravitySteady)
+			{
+				owner.Stats.GravityCorrectionsStarted += wasGravitySteady ? 0 : 1;
+				owner.Stats.GravityCorrectionTime += deltaTime;
+			}
+#endif
+
+			owner.RawAccel.x = accelX;
+			owner.RawAccel.y = accelY;
+			owner.RawAccel.z = accelZ;
+
+			owner.AccumulatedGyro.AddSample(owner.Gyro, owner.Motion.LastGyroRotation, deltaTime);
+			owner.RecentGyro.AddSample(owner.Gyro, deltaTime);
+
+			if (owner.Publisher != nullptr)
+			{
+				owner.Publisher->AddSample(owner.Gyro, owner.Motion.LastGyroRotation, deltaTime);
+			}
+
+			const int changes = MotionUpdated |
+				(calibrationChanged ? CalibrationChanged : 0) |
+				(still != wasStill ? StillnessChanged : 0) |
+				(gravitySteady != wasGravitySteady ? GravitySteadyChanged : 0);
+			owner.Changes = (MotionChanges)(owner.Changes | changes);
+			if (owner.ChangeCallback != nullptr && (changes & owner.ChangeCallbackMask) != 0)
+			{
+				owner.ChangeCallback(owner, (MotionChanges)(changes & owner.ChangeCallbackMask), owner.ChangeCallbackUserData);
+			}
+		}
+	}
+} // namespace GamepadMotionHelpers
+
+#if GAMEPADMOTION_DEFINITIONS
+GAMEPADMOTION_API GamepadMotionPublisher::GamepadMotionPublisher()
+{
+	Reset();
+}
+
+GAMEPADMOTION_API void GamepadMotionPublisher::Reset()
+{
+	memset(Buffers, 0, sizeof(Buffers));
+	Middle.store(1, std::memory_order_relaxed);
+	WriteIndex = 0;
+	ReadIndex = 2;
+	PublishCount = 0;
+	Totals.Reset();
+	HasConsumed = false;
+	memset(&LastConsumed, 0, sizeof(LastConsumed));
+}
+
+GAMEPADMOTION_API bool GamepadMotionPublisher::Read(GamepadMotionPublishedState& outState)
+{
+	// swap in the latest buffer if there's a new one. Otherwise keep reading the one we've got
+	if ((Middle.load(std::memory_order_relaxed) & FreshFlag) != 0)
+	{
+		ReadIndex = Middle.exchange(ReadIndex, std::memory_order_acq_rel) & ~FreshFlag;
+	}
+
+	outState = Buffers[ReadIndex].State;
+	return outState.Sequence != 0;
+}
+
+GAMEPADMOTION_API bool GamepadMotionPublisher::Consume(GamepadMotionPublishedState& outState, GamepadMotionDelta& outDelta)
+{
+	if (!Read(outState))
+	{
+		memset(&outDelta, 0, sizeof(outDelta));
+		outDelta.Rotation[0] = 1.f;
+		return false;
+	}
+
+	if (!HasConsumed)
+	{
+		// everything up to now counts as the first delta
+		memset(&LastConsumed, 0, sizeof(LastConsumed));
+		LastConsumed.TotalRotation[0] = 1.f;
+		HasConsumed = true;
+	}
+
+	GamepadMotionHelpers::GetGyroDelta(LastConsumed.TotalGyroAngle, LastConsumed.TotalRotation, LastConsumed.TotalTime, LastConsumed.TotalSamples,
+		outState.TotalGyroAngle, outState.TotalRotation, outState.TotalTime, outState.TotalSamples, outDelta);
+	LastConsumed = outState;
+	return true;
+}
+
+GAMEPADMOTION_API void GamepadMotionPublisher::AddSample(const GamepadMotionHelpers::Vec& inGyro, const GamepadMotionHelpers::Quat& inRotation, float deltaTime)
+{
+	Totals.AddSample(inGyro, inRotation, deltaTime);
+}
+
+GAMEPADMOTION_API void GamepadMotionPublisher::Publish(GamepadMotion& motion)
+{
+	GamepadMotionPublishedState& state = Buffers[WriteIndex].State;
+	motion.GetCalibratedGyro(state.CalibratedGyro[0], state.CalibratedGyro[1], state.CalibratedGyro[2]);
+	motion.GetGravity(state.Gravity[0], state.Gravity[1], state.Gravity[2]);
+	motion.GetProcessedAcceleration(state.ProcessedAcceleration[0], state.ProcessedAcceleration[1], state.ProcessedAcceleration[2]);
+	motion.GetOrientation(state.Orientation[0], state.Orientation[1], state.Orientation[2], state.Orientation[3]);
+	state.TotalGyroAngle[0] = Totals.AngleX;
+	state.TotalGyroAngle[1] = Totals.AngleY;
+	state.TotalGyroAngle[2] = Totals.AngleZ;
+	state.TotalRotation[0] = Totals.Rotation.w;
+	state.TotalRotation[1] = Totals.Rotation.x;
+	state.TotalRotation[2] = Totals.Rotation.y;
+	state.TotalRotation[3] = Totals.Rotation.z;
+	state.TotalTime = Totals.Time;
+	state.TotalSamples = Totals.NumSamples;
+	PublishCount++;
+	state.Sequence = PublishCount == 0 ? ++PublishCount : PublishCount;
+
+	// hand the finished buffer over and take whichever one the reader isn't using
+	WriteIndex = Middle.exchange(WriteIndex | FreshFlag, std::memory_order_acq_rel) & ~FreshFlag;
+}
+
+GAMEPADMOTION_API GamepadMotionSettingsProfile::GamepadMotionSettingsProfile()
+{
+	SetSettings(GamepadMotionSettings());
+}
+
+GAMEPADMOTION_API GamepadMotionSettingsProfile::GamepadMotionSettingsProfile(const GamepadMotionSettings& settings)
+{
+	SetSettings(settings);
+}
+
+GAMEPADMOTION_API void GamepadMotionSettingsProfile::SetSettings(const GamepadMotionSettings& settings)
+{
+	Settings = settings;
+
+	StillnessCalibrationInverseEaseInTime = settings.StillnessCalibrationEaseInTime <= 0.f ? 0.f : 1.f / settings.StillnessCalibrationEaseInTime;
+	StillnessCalibrationInverseHalfTime = settings.StillnessCalibrationHalfTime <= 0.f ? 0.f : 1.f / settings.StillnessCalibrationHalfTime;
+	SensorFusionCalibrationInverseEaseInTime = settings.SensorFusionCalibrationEaseInTime <= 0.f ? 0.f : 1.f / settings.SensorFusionCalibrationEaseInTime;
+	SensorFusionCalibrationInverseHalfTime = settings.SensorFusionCalibrationHalfTime <= 0.f ? 0.f : 1.f / settings.SensorFusionCalibrationHalfTime;
+	SteadyGravityThresholdSquared = settings.SteadyGravityThreshold * settings.SteadyGravityThreshold;
+	GravityCorrectInverseEaseInTime = settings.GravityCorrectEaseInTime <= 0.f ? 0.f : 1.f / settings.GravityCorrectEaseInTime;
+	GravityCorrectInverseHalfTime = settings.GravityCorrectHalfTime <= 0.f ? 0.f : 1.f / settings.GravityCorrectHalfTime;
+	const float gravityCorrectMinAngleCos = GamepadMotionHelpers::Cos(std::clamp(settings.GravityCorrectMinAngle, 0.f, 90.f) * (float)M_PI / 180.f);
+	GravityCorrectMinAngleCosSquared = settings.GravityCorrectMinAngle <= 0.f ? 2.f : gravityCorrectMinAngleCos * gravityCorrectMinAngleCos;
+	MagnetometerCorrectInverseHalfTime = settings.MagnetometerCorrectHalfTime <= 0.f ? 0.f : 1.f / settings.MagnetometerCorrectHalfTime;
+}
+
+GAMEPADMOTION_API const GamepadMotionSettings& GamepadMotionSettingsProfile::GetSettings() const
+{
+	return Settings;
+}
+
+GAMEPADMOTION_API GamepadMotion::GamepadMotion()
+{
+	IsCalibrating = false;
+	CurrentCalibrationMode = GamepadMotionHelpers::CalibrationMode::Manual;
+	SharedSettingsProfile = nullptr;
+	Publisher = nullptr;
+	RawGyroScale = GamepadMotionHelpers::Vec(1.f);
+	RawAccelScale = GamepadMotionHelpers::Vec(1.f);
+	ChangeCallback = nullptr;
+	ChangeCallbackMask = GamepadMotionHelpers::NoChanges;
+	ChangeCallbackUserData = nullptr;
+	ResetStats();
+	Reset();
+	AutoCalibration.SetCalibrationData(&GyroCalibration);
+	SetSettingsProfile(nullptr);
+}
+
+GAMEPADMOTION_API GamepadMotion::GamepadMotion(const GamepadMotion& other)
+{
+	Publisher = nullptr;
+	CopyState(other);
+}
+
+GAMEPADMOTION_API GamepadMotion::GamepadMotion(GamepadMotion&& other) noexcept
+{
+	CopyState(other);
+	Publisher = other.Publisher;
+	other.Publisher = nullptr;
+}
+
+GAMEPADMOTION_API GamepadMotion& GamepadMotion::operator=(const GamepadMotion& other)
+{
+	if (this != &other)
+	{
+		CopyState(other);
+	}
+	return *this;
+}
+
+GAMEPADMOTION_API GamepadMotion& GamepadMotion::operator=(GamepadMotion&& other) noexcept
+{
+	if (this != &other)
+	{
+		CopyState(other);
+		Publisher = other.Publisher;
+		other.Publisher = nullptr;
+	}
+	return *this;
+}
+
+// everything but the publisher, with calibration and settings pointed back at this object
+GAMEPADMOTION_API void GamepadMotion::CopyState(const GamepadMotion& other)
+{
+	Motion = other.Motion;
+	Gyro = other.Gyro;
+	RawAccel = other.RawAccel;
+	GyroCalibration = other.GyroCalibration;
+	CurrentCalibrationMode = other.CurrentCalibrationMode;
+	Changes = other.Changes;
+	IsCalibrating = other.IsCalibrating;
+	ChangeCallbackMask = other.ChangeCallbackMask;
+	ChangeCallback = other.ChangeCallback;
+	AccumulatedGyro = other.AccumulatedGyro;
+	SharedSettingsProfile = other.SharedSettingsProfile;
+	OwnSettingsProfile = other.OwnSettingsProfile;
+	AutoCalibration = other.AutoCalibration;
+	TemperatureBias = other.TemperatureBias;
+	RecentGyro = other.RecentGyro;
+	RawGyroScale = other.RawGyroScale;
+	RawAccelScale = other.RawAccelScale;
+	Timestamps = other.Timestamps;
+	ChangeCallbackUserData = other.ChangeCallbackUserData;
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+	Stats = other.Stats;
+#endif
+	Settings = other.Settings;
+
+	AutoCalibration.SetCalibrationData(&GyroCalibration);
+	SetSettingsProfile(SharedSettingsProfile);
+}
+
+GAMEPADMOTION_API void GamepadMotion::Reset()
+{
+	GyroCalibration = {};
+	Gyro = {};
+	RawAccel = {};
+	Settings = GamepadMotionSettings();
+	Motion.Reset();
+	AccumulatedGyro.Reset();
+	RecentGyro.Reset();
+	Timestamps.Reset();
+	TemperatureBias.Reset();
+	Changes = GamepadMotionHelpers::AllChanges;
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotion(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime)
+{
+	ProcessMotionSample(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, nullptr);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotion(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ,
+	float magnetometerX, float magnetometerY, float magnetometerZ, float deltaTime)
+{
+	const float magnetometer[3] = { magnetometerX, magnetometerY, magnetometerZ };
+	ProcessMotionSample(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionSample(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime, const float* magnetometer)
+{
+	UpdateSettingsProfile();
+
+	if (IsCalibrating)
+	{
+		GamepadMotionHelpers::MotionStep::Process<true, false, false>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::SensorFusion) != 0 &&
+		(CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::Stillness) != 0)
+	{
+		GamepadMotionHelpers::MotionStep::Process<false, true, true>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::SensorFusion) != 0)
+	{
+		GamepadMotionHelpers::MotionStep::Process<false, true, false>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::Stillness) != 0)
+	{
+		GamepadMotionHelpers::MotionStep::Process<false, false, true>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+	}
+	else
+	{
+		GamepadMotionHelpers::MotionStep::Process<false, false, false>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, magnetometer);
+	}
+
+	if (Publisher != nullptr)
+	{
+		Publisher->Publish(*this);
+	}
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionBatch(const GamepadMotionHelpers::MotionSample* samples, int numSamples,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	if (samples == nullptr || numSamples <= 0)
+	{
+		return;
+	}
+
+	const int stride = sizeof(GamepadMotionHelpers::MotionSample) / sizeof(float);
+	ProcessMotionStrided(&samples->GyroX, stride, &samples->AccelX, stride, nullptr, 0, &samples->DeltaTime, stride,
+		numSamples, outCalibratedGyro, outOrientation);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionBatch(const float* gyroXYZ, const float* accelXYZ, const float* deltaTimes, int numSamples,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	if (gyroXYZ == nullptr || accelXYZ == nullptr || deltaTimes == nullptr || numSamples <= 0)
+	{
+		return;
+	}
+
+	ProcessMotionStrided(gyroXYZ, 3, accelXYZ, 3, nullptr, 0, deltaTimes, 1, numSamples, outCalibratedGyro, outOrientation);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionBatch(const float* gyroXYZ, const float* accelXYZ, const float* magnetometerXYZ, const float* deltaTimes, int numSamples,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	if (gyroXYZ == nullptr || accelXYZ == nullptr || magnetometerXYZ == nullptr || deltaTimes == nullptr || numSamples <= 0)
+	{
+		return;
+	}
+
+	ProcessMotionStrided(gyroXYZ, 3, accelXYZ, 3, magnetometerXYZ, 3, deltaTimes, 1, numSamples, outCalibratedGyro, outOrientation);
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetRawSensorScale(float gyroScale, float accelScale)
+{
+	SetRawSensorScale(gyroScale, gyroScale, gyroScale, accelScale, accelScale, accelScale);
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetRawSensorScale(float gyroScaleX, float gyroScaleY, float gyroScaleZ, float accelScaleX, float accelScaleY, float accelScaleZ)
+{
+	RawGyroScale = GamepadMotionHelpers::Vec(gyroScaleX, gyroScaleY, gyroScaleZ);
+	RawAccelScale = GamepadMotionHelpers::Vec(accelScaleX, accelScaleY, accelScaleZ);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionRaw(int16_t gyroX, int16_t gyroY, int16_t gyroZ, int16_t accelX, int16_t accelY, int16_t accelZ, float deltaTime)
+{
+	ProcessMotion(gyroX * RawGyroScale.x, gyroY * RawGyroScale.y, gyroZ * RawGyroScale.z,
+		accelX * RawAccelScale.x, accelY * RawAccelScale.y, accelZ * RawAccelScale.z, deltaTime);
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetTimestampFormat(double ticksPerSecond, int numBits, float smoothingHalfTime)
+{
+	Timestamps.SetFormat(ticksPerSecond, numBits, smoothingHalfTime);
+}
+
+GAMEPADMOTION_API bool GamepadMotion::ProcessMotionTimestamped(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, uint64_t timestamp)
+{
+	GAMEPADMOTION_STAT(const bool duplicate = Timestamps.HasTimestamp && (timestamp & Timestamps.Mask) == Timestamps.LastTimestamp);
+	const float deltaTime = Timestamps.Update(timestamp);
+	if (deltaTime < 0.f)
+	{
+		GAMEPADMOTION_STAT(Stats.DuplicateSamples += duplicate ? 1 : 0);
+		return false;
+	}
+
+	ProcessMotion(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime);
+	return true;
+}
+
+GAMEPADMOTION_API bool GamepadMotion::ProcessMotionRawTimestamped(int16_t gyroX, int16_t gyroY, int16_t gyroZ, int16_t accelX, int16_t accelY, int16_t accelZ, uint64_t timestamp)
+{
+	return ProcessMotionTimestamped(gyroX * RawGyroScale.x, gyroY * RawGyroScale.y, gyroZ * RawGyroScale.z,
+		accelX * RawAccelScale.x, accelY * RawAccelScale.y, accelZ * RawAccelScale.z, timestamp);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionBatchRaw(const void* gyroXYZ, const void* accelXYZ, int strideBytes, int numSamples, float deltaTime,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	if (gyroXYZ == nullptr || accelXYZ == nullptr || numSamples <= 0)
+	{
+		return;
+	}
+
+	// convert a block at a time into a small buffer that stays in cache, rather than converting the whole batch first
+	const int blockSize = 32;
+	float gyro[blockSize * 3];
+	float accel[blockSize * 3];
+	const float gyroScaleX = RawGyroScale.x, gyroScaleY = RawGyroScale.y, gyroScaleZ = RawGyroScale.z;
+	const float accelScaleX = RawAccelScale.x, accelScaleY = RawAccelScale.y, accelScaleZ = RawAccelScale.z;
+	const unsigned char* gyroBytes = (const unsigned char*)gyroXYZ;
+	const unsigned char* accelBytes = (const unsigned char*)accelXYZ;
+
+	while (numSamples > 0)
+	{
+		const int count = std::min(numSamples, blockSize);
+		for (int i = 0; i < count; i++)
+		{
+			const unsigned char* gyroSample = gyroBytes + (intptr_t)i * strideBytes;
+			const unsigned char* accelSample = accelBytes + (intptr_t)i * strideBytes;
+			gyro[i * 3 + 0] = GamepadMotionHelpers::LoadRawSensor(gyroSample + 0) * gyroScaleX;
+			gyro[i * 3 + 1] = GamepadMotionHelpers::LoadRawSensor(gyroSample + 2) * gyroScaleY;
+			gyro[i * 3 + 2] = GamepadMotionHelpers::LoadRawSensor(gyroSample + 4) * gyroScaleZ;
+			accel[i * 3 + 0] = GamepadMotionHelpers::LoadRawSensor(accelSample + 0) * accelScaleX;
+			accel[i * 3 + 1] = GamepadMotionHelpers::LoadRawSensor(accelSample + 2) * accelScaleY;
+			accel[i * 3 + 2] = GamepadMotionHelpers::LoadRawSensor(accelSample + 4) * accelScaleZ;
+		}
+
+		ProcessMotionStrided(gyro, 3, accel, 3, nullptr, 0, &deltaTime, 0, count, outCalibratedGyro, outOrientation);
+
+		gyroBytes += (intptr_t)count * strideBytes;
+		accelBytes += (intptr_t)count * strideBytes;
+		if (outCalibratedGyro != nullptr)
+		{
+			outCalibratedGyro += count * 3;
+		}
+		if (outOrientation != nullptr)
+		{
+			outOrientation += count * 4;
+		}
+		numSamples -= count;
+	}
+}
+
+GAMEPADMOTION_API void GamepadMotion::ProcessMotionStrided(const float* gyro, int gyroStride, const float* accel, int accelStride, const float* magnetometer, int magnetometerStride,
+	const float* deltaTimes, int deltaTimeStride, int numSamples, float* outCalibratedGyro, float* outOrientation)
+{
+	UpdateSettingsProfile();
+
+	// the calibration mode can't change mid-batch, so pick the specialised loop once
+	if (IsCalibrating)
+	{
+		ProcessMotionLoop<true, false, false>(gyro, gyroStride, accel, accelStride, magnetometer, magnetometerStride, deltaTimes, deltaTimeStride,
+			numSamples, outCalibratedGyro, outOrientation);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::SensorFusion) != 0 &&
+		(CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::Stillness) != 0)
+	{
+		ProcessMotionLoop<false, true, true>(gyro, gyroStride, accel, accelStride, magnetometer, magnetometerStride, deltaTimes, deltaTimeStride,
+			numSamples, outCalibratedGyro, outOrientation);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::SensorFusion) != 0)
+	{
+		ProcessMotionLoop<false, true, false>(gyro, gyroStride, accel, accelStride, magnetometer, magnetometerStride, deltaTimes, deltaTimeStride,
+			numSamples, outCalibratedGyro, outOrientation);
+	}
+	else if ((CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::Stillness) != 0)
+	{
+		ProcessMotionLoop<false, false, true>(gyro, gyroStride, accel, accelStride, magnetometer, magnetometerStride, deltaTimes, deltaTimeStride,
+			numSamples, outCalibratedGyro, outOrientation);
+	}
+	else
+	{
+		ProcessMotionLoop<false, false, false>(gyro, gyroStride, accel, accelStride, magnetometer, magnetometerStride, deltaTimes, deltaTimeStride,
+			numSamples, outCalibratedGyro, outOrientation);
+	}
+
+	if (Publisher != nullptr)
+	{
+		Publisher->Publish(*this);
+	}
+}
+
+template<bool Calibrating, bool SensorFusion, bool Stillness>
+void GamepadMotion::ProcessMotionLoop(const float* gyro, int gyroStride, const float* accel, int accelStride, const float* magnetometer, int magnetometerStride,
+	const float* deltaTimes, int deltaTimeStride, int numSamples, float* outCalibratedGyro, float* outOrientation)
+{
+	for (int i = 0; i < numSamples; i++)
+	{
+		GamepadMotionHelpers::MotionStep::Process<Calibrating, SensorFusion, Stillness>(*this, gyro[0], gyro[1], gyro[2], accel[0], accel[1], accel[2], *deltaTimes, magnetometer);
+		gyro += gyroStride;
+		accel += accelStride;
+		magnetometer += magnetometerStride; // stays nullptr without a magnetometer, since the stride is 0
+		deltaTimes += deltaTimeStride;
+
+		if (outCalibratedGyro != nullptr)
+		{
+			outCalibratedGyro[0] = Gyro.x;
+			outCalibratedGyro[1] = Gyro.y;
+			outCalibratedGyro[2] = Gyro.z;
+			outCalibratedGyro += 3;
+		}
+
+		if (outOrientation != nullptr)
+		{
+			outOrientation[0] = Motion.Quaternion.w;
+			outOrientation[1] = Motion.Quaternion.x;
+			outOrientation[2] = Motion.Quaternion.y;
+			outOrientation[3] = Motion.Quaternion.z;
+			outOrientation += 4;
+		}
+	}
+}
+
+// reading the current state
+GAMEPADMOTION_API void GamepadMotion::GetCalibratedGyro(float& x, float& y, float& z)
+{
+	x = Gyro.x;
+	y = Gyro.y;
+	z = Gyro.z;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetGravity(float& x, float& y, float& z)
+{
+	Motion.ResolveGravity();
+	x = Motion.Grav.x;
+	y = Motion.Grav.y;
+	z = Motion.Grav.z;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetProcessedAcceleration(float& x, float& y, float& z)
+{
+	Motion.ResolveGravity();
+	x = Motion.Accel.x;
+	y = Motion.Accel.y;
+	z = Motion.Accel.z;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetOrientation(float& w, float& x, float& y, float& z)
+{
+	w = Motion.Quaternion.w;
+	x = Motion.Quaternion.x;
+	y = Motion.Quaternion.y;
+	z = Motion.Quaternion.z;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetAccumulatedGyro(GamepadMotionDelta& outDelta)
+{
+	AccumulatedGyro.GetTotals(outDelta);
+}
+
+GAMEPADMOTION_API void GamepadMotion::ConsumeAccumulatedGyro(GamepadMotionDelta& outDelta)
+{
+	AccumulatedGyro.GetTotals(outDelta);
+	AccumulatedGyro.Reset();
+}
+
+GAMEPADMOTION_API void GamepadMotion::PredictCalibratedGyro(float deltaTime, float& x, float& y, float& z)
+{
+	const GamepadMotionHelpers::Vec predicted = Gyro + RecentGyro.GetAngularAcceleration() * deltaTime;
+	x = predicted.x;
+	y = predicted.y;
+	z = predicted.z;
+}
+
+GAMEPADMOTION_API void GamepadMotion::PredictOrientation(float deltaTime, float& w, float& x, float& y, float& z)
+{
+	// rotate by the average of the current and predicted gyro, the same way Motion::Update rotates by each sample
+	const GamepadMotionHelpers::Vec averageGyro = Gyro + RecentGyro.GetAngularAcceleration() * (deltaTime * 0.5f);
+	const float angle = averageGyro.Length() * (float)M_PI / 180.0f * deltaTime;
+	GamepadMotionHelpers::Quat predicted = Motion.Quaternion;
+	predicted *= GamepadMotionHelpers::AngleAxis(angle, averageGyro.x, averageGyro.y, averageGyro.z);
+	predicted.Renormalize();
+	w = predicted.w;
+	x = predicted.x;
+	y = predicted.y;
+	z = predicted.z;
+}
+
+// gyro calibration functions
+GAMEPADMOTION_API void GamepadMotion::StartContinuousCalibration()
+{
+	IsCalibrating = true;
+}
+
+GAMEPADMOTION_API void GamepadMotion::PauseContinuousCalibration()
+{
+	IsCalibrating = false;
+}
+
+GAMEPADMOTION_API void GamepadMotion::ResetContinuousCalibration()
+{
+	GyroCalibration = {};
+	TemperatureBias.Unsettle();
+	Changes = Changes | GamepadMotionHelpers::CalibrationChanged;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetCalibrationOffset(float& xOffset, float& yOffset, float& zOffset)
+{
+	float accelMagnitude;
+	GetCalibratedSensor(xOffset, yOffset, zOffset, accelMagnitude);
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetCalibrationOffset(float xOffset, float yOffset, float zOffset, int weight)
+{
+	if (GyroCalibration.NumSamples > 1)
+	{
+		GyroCalibration.AccelMagnitude *= ((float)weight) / GyroCalibration.NumSamples;
+	}
+	else
+	{
+		GyroCalibration.AccelMagnitude = (float)weight;
+	}
+
+	GyroCalibration.NumSamples = weight;
+	GyroCalibration.X = xOffset * weight;
+	GyroCalibration.Y = yOffset * weight;
+	GyroCalibration.Z = zOffset * weight;
+	Changes = Changes | GamepadMotionHelpers::CalibrationChanged;
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetTemperature(float temperature)
+{
+	// move the stored calibration along the fit to the new temperature, so reading the offset costs nothing extra and
+	// auto-calibration carries on from where the fit says the bias is now
+	GamepadMotionHelpers::Vec slope;
+	if (TemperatureBias.HasTemperature && temperature != TemperatureBias.Temperature && GyroCalibration.NumSamples > 0 && TemperatureBias.GetSlope(slope))
+	{
+		const GamepadMotionHelpers::Vec change = slope * ((temperature - TemperatureBias.Temperature) * GyroCalibration.NumSamples);
+		GyroCalibration.X += change.x;
+		GyroCalibration.Y += change.y;
+		GyroCalibration.Z += change.z;
+		Changes = Changes | GamepadMotionHelpers::CalibrationChanged;
+	}
+	TemperatureBias.SetTemperature(temperature);
+}
+
+GAMEPADMOTION_API bool GamepadMotion::GetTemperatureBiasSlope(float& x, float& y, float& z)
+{
+	GamepadMotionHelpers::Vec slope;
+	const bool hasSlope = TemperatureBias.GetSlope(slope);
+	x = hasSlope ? slope.x : 0.f;
+	y = hasSlope ? slope.y : 0.f;
+	z = hasSlope ? slope.z : 0.f;
+	return hasSlope;
+}
+
+GAMEPADMOTION_API GamepadMotionHelpers::CalibrationMode GamepadMotion::GetCalibrationMode()
+{
+	return CurrentCalibrationMode;
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetCalibrationMode(GamepadMotionHelpers::CalibrationMode calibrationMode)
+{
+	CurrentCalibrationMode = calibrationMode;
+}
+
+GAMEPADMOTION_API void GamepadMotion::ResetMotion()
+{
+	Motion.Reset();
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile)
+{
+	SharedSettingsProfile = settingsProfile;
+	const GamepadMotionSettingsProfile* activeProfile = settingsProfile != nullptr ? settingsProfile : &OwnSettingsProfile;
+	AutoCalibration.SetSettings(activeProfile);
+	Motion.SetSettings(activeProfile);
+}
+
+GAMEPADMOTION_API const GamepadMotionSettingsProfile* GamepadMotion::GetSettingsProfile()
+{
+	return SharedSettingsProfile;
+}
+
+GAMEPADMOTION_API void GamepadMotion::SaveSnapshot(GamepadMotionSnapshot& outSnapshot)
+{
+	outSnapshot = GamepadMotionSnapshot{};
+	outSnapshot.Version = GamepadMotionSnapshot::CurrentVersion;
+	outSnapshot.Size = (int)sizeof(GamepadMotionSnapshot);
+	outSnapshot.Settings = Settings;
+	outSnapshot.GyroCalibration = GyroCalibration;
+	Motion.ResolveGravity();
+	Motion.SaveSnapshot(outSnapshot.Motion);
+	AutoCalibration.SaveSnapshot(outSnapshot.AutoCalibration);
+	TemperatureBias.SaveSnapshot(outSnapshot.TemperatureBias);
+	GamepadMotionHelpers::StoreVec(Gyro, outSnapshot.Gyro);
+	GamepadMotionHelpers::StoreVec(RawAccel, outSnapshot.RawAccel);
+	outSnapshot.CalibrationMode = (int)CurrentCalibrationMode;
+	outSnapshot.IsCalibrating = IsCalibrating ? 1 : 0;
+}
+
+GAMEPADMOTION_API bool GamepadMotion::LoadSnapshot(const GamepadMotionSnapshot& snapshot)
+{
+	if (snapshot.Version != GamepadMotionSnapshot::CurrentVersion || snapshot.Size != (int)sizeof(GamepadMotionSnapshot) ||
+		!GamepadMotionHelpers::AutoCalibration::IsValidSnapshot(snapshot.AutoCalibration))
+	{
+		return false;
+	}
+
+	Settings = snapshot.Settings;
+	GyroCalibration = snapshot.GyroCalibration;
+	Motion.LoadSnapshot(snapshot.Motion);
+	RecentGyro.Reset();
+	AutoCalibration.LoadSnapshot(snapshot.AutoCalibration);
+	TemperatureBias.LoadSnapshot(snapshot.TemperatureBias);
+	Gyro = GamepadMotionHelpers::LoadVec(snapshot.Gyro);
+	RawAccel = GamepadMotionHelpers::LoadVec(snapshot.RawAccel);
+	CurrentCalibrationMode = (GamepadMotionHelpers::CalibrationMode)snapshot.CalibrationMode;
+	IsCalibrating = snapshot.IsCalibrating != 0;
+	Changes = GamepadMotionHelpers::AllChanges;
+	return true;
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetPublisher(GamepadMotionPublisher* publisher)
+{
+	Publisher = publisher;
+}
+
+GAMEPADMOTION_API GamepadMotionStats GamepadMotion::GetStats()
+{
+#if defined(GAMEPADMOTION_INSTRUMENTATION)
+	return Stats;
+#else
+	return {};
+#endif
+}
+
+GAMEPADMOTION_API void GamepadMotion::ResetStats()
+{
+	GAMEPADMOTION_STAT(Stats = {});
+	GAMEPADMOTION_STAT(Stats.RecalibrateThreshold = AutoCalibration.GetRecalibrateThreshold());
+}
+
+GAMEPADMOTION_API GamepadMotionHelpers::MotionChanges GamepadMotion::ConsumeChanges()
+{
+	const GamepadMotionHelpers::MotionChanges changes = Changes;
+	Changes = GamepadMotionHelpers::NoChanges;
+	return changes;
+}
+
+GAMEPADMOTION_API bool GamepadMotion::IsStill()
+{
+	return AutoCalibration.GetTimeSteadyStillness() > 0.f;
+}
+
+GAMEPADMOTION_API bool GamepadMotion::IsGravitySteady()
+{
+	return Motion.TimeCorrecting > 0.f;
+}
+
+GAMEPADMOTION_API void GamepadMotion::SetChangeCallback(GamepadMotionChangeCallback callback, GamepadMotionHelpers::MotionChanges changes, void* userData)
+{
+	ChangeCallback = callback;
+	ChangeCallbackMask = changes;
+	ChangeCallbackUserData = userData;
+}
+
+// Private Methods
+
+GAMEPADMOTION_API void GamepadMotion::UpdateSettingsProfile()
+{
+	// only work out derived settings again if Settings has been changed
+	if (SharedSettingsProfile == nullptr && memcmp(&OwnSettingsProfile.GetSettings(), &Settings, sizeof(GamepadMotionSettings)) != 0)
+	{
+		OwnSettingsProfile.SetSettings(Settings);
+	}
+}
+
+GAMEPADMOTION_API void GamepadMotion::PushSensorSamples(float gyroX, float gyroY, float gyroZ, float accelMagnitude)
+{
+	// accumulate
+	GyroCalibration.NumSamples++;
+	GyroCalibration.X += gyroX;
+	GyroCalibration.Y += gyroY;
+	GyroCalibration.Z += gyroZ;
+	GyroCalibration.AccelMagnitude += accelMagnitude;
+}
+
+GAMEPADMOTION_API void GamepadMotion::GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY, float& gyroOffsetZ, float& accelMagnitude)
+{
+	if (GyroCalibration.NumSamples <= 0)
+	{
+		gyroOffsetX = 0.f;
+		gyroOffsetY = 0.f;
+		gyroOffsetZ = 0.f;
+		accelMagnitude = 0.f;
+		return;
+	}
+
+	const float inverseSamples = 1.f / GyroCalibration.NumSamples;
+	gyroOffsetX = GyroCalibration.X * inverseSamples;
+	gyroOffsetY = GyroCalibration.Y * inverseSamples;
+	gyroOffsetZ = GyroCalibration.Z * inverseSamples;
+	accelMagnitude = GyroCalibration.AccelMagnitude * inverseSamples;
+}
+
+// GamepadMotionResampler
+GAMEPADMOTION_API GamepadMotionResampler::GamepadMotionResampler()
+{
+	OutputPeriod = 1.f / 250.f;
+	Reset();
+}
+
+GAMEPADMOTION_API void GamepadMotionResampler::Reset()
+{
+	InputGyroTotal = GamepadMotionHelpers::Vec();
+	InputAccelTotal = GamepadMotionHelpers::Vec();
+	InputTime = 0.f;
+	OutputGyroTotal = GamepadMotionHelpers::Vec();
+	OutputTime = 0.f;
+}
+
+GAMEPADMOTION_API void GamepadMotionResampler::SetOutputRate(float samplesPerSecond)
+{
+	if (samplesPerSecond > 0.f)
+	{
+		OutputPeriod = 1.f / samplesPerSecond;
+	}
+}
+
+GAMEPADMOTION_API float GamepadMotionResampler::GetOutputRate()
+{
+	return 1.f / OutputPeriod;
+}
+
+GAMEPADMOTION_API int GamepadMotionResampler::ProcessMotion(GamepadMotion& motion, float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime,
+	GamepadMotionResampledSample* outSamples, int maxOutSamples)
+{
+	if (deltaTime <= 0.f)
+	{
+		return 0;
+	}
+
+	InputGyroTotal += GamepadMotionHelpers::Vec(gyroX, gyroY, gyroZ) * deltaTime;
+	InputAccelTotal += GamepadMotionHelpers::Vec(accelX, accelY, accelZ) * deltaTime;
+	InputTime += deltaTime;
+
+	const float periodEnd = OutputPeriod * (1.f - PeriodTolerance);
+	if (OutputTime + InputTime < periodEnd)
+	{
+		return 0;
+	}
+
+	// process everything since the last time as one sample, and remember where orientation was before it to interpolate from
+	GamepadMotionHelpers::Quat fromOrientation;
+	motion.GetOrientation(fromOrientation.w, fromOrientation.x, fromOrientation.y, fromOrientation.z);
+	const float inverseInputTime = 1.f / InputTime;
+	const GamepadMotionHelpers::Vec gyro = InputGyroTotal * inverseInputTime;
+	const GamepadMotionHelpers::Vec accel = InputAccelTotal * inverseInputTime;
+	motion.ProcessMotion(gyro.x, gyro.y, gyro.z, accel.x, accel.y, accel.z, InputTime);
+
+	GamepadMotionHelpers::Vec calibratedGyro;
+	GamepadMotionHelpers::Quat toOrientation;
+	motion.GetCalibratedGyro(calibratedGyro.x, calibratedGyro.y, calibratedGyro.z);
+	motion.GetOrientation(toOrientation.w, toOrientation.x, toOrientation.y, toOrientation.z);
+
+	// split the processed sample between every output period it finishes
+	int numOutSamples = 0;
+	float timeUsed = 0.f;
+	while (OutputTime + (InputTime - timeUsed) >= periodEnd)
+	{
+		const float timeTaken = std::min(OutputPeriod - OutputTime, InputTime - timeUsed);
+		OutputGyroTotal += calibratedGyro * timeTaken;
+		timeUsed += timeTaken;
+
+		if (numOutSamples < maxOutSamples && outSamples != nullptr)
+		{
+			GamepadMotionResampledSample& outSample = outSamples[numOutSamples];
+			GamepadMotionHelpers::StoreVec(OutputGyroTotal / OutputPeriod, outSample.CalibratedGyro);
+			const GamepadMotionHelpers::Quat orientation = timeUsed >= InputTime ? toOrientation
+				: GamepadMotionHelpers::Slerp(fromOrientation, toOrientation, timeUsed * inverseInputTime);
+			outSample.Orientation[0] = orientation.w;
+			outSample.Orientation[1] = orientation.x;
+			outSample.Orientation[2] = orientation.y;
+			outSample.Orientation[3] = orientation.z;
+			numOutSamples++;
+		}
+
+		OutputGyroTotal = GamepadMotionHelpers::Vec();
+		OutputTime = 0.f;
+	}
+
+	const float timeLeft = InputTime - timeUsed;
+	OutputGyroTotal += calibratedGyro * timeLeft;
+	OutputTime += timeLeft;
+
+	InputGyroTotal = GamepadMotionHelpers::Vec();
+	InputAccelTotal = GamepadMotionHelpers::Vec();
+	InputTime = 0.f;
+	return numOutSamples;
+}
+#endif // GAMEPADMOTION_DEFINITIONS
+
+// GamepadMotionPool
+
+namespace GamepadMotionHelpers
+{
+	// branch-free versions of the Quat and Vec operations used by Motion::Update, working on loose floats so that
+	// GamepadMotionPool can apply them across many controllers at once. Operations are in the same order as the
+	// Quat and Vec versions so that results match GamepadMotion.
+	inline void PoolQuatMultiply(float& w, float& x, float& y, float& z, float rw, float rx, float ry, float rz)
+	{
+		const float nw = w * rw - x * rx - y * ry - z * rz;
+		const float nx = w * rx + x * rw + y * rz - z * ry;
+		const float ny = w * ry - x * rz + y * rw + z * rx;
+		const float nz = w * rz + x * ry - y * rx + z * rw;
+		w = nw;
+		x = nx;
+		y = ny;
+		z = nz;
+	}
+
+	inline void PoolQuatNormalize(float& w, float& x, float& y, float& z)
+	{
+		const float length = sqrtf(x * x + y * y + z * z);
+		const float targetLength = 1.0f - w * w;
+		const bool degenerate = targetLength <= 0.0f || length <= 0.0f;
+		const float fixFactor = sqrtf(degenerate ? 1.0f : targetLength) / (degenerate ? 1.0f : length);
+		w = degenerate ? 1.0f : w;
+		x = degenerate ? 0.0f : x * fixFactor;
+		y = degenerate ? 0.0f : y * fixFactor;
+		z = degenerate ? 0.0f : z * fixFactor;
+	}
+
+	// same as Quat::Renormalize
+	inline void PoolQuatRenormalize(float& w, float& x, float& y, float& z)
+	{
+		const float lengthSquared = w * w + x * x + y * y + z * z;
+		const bool degenerate = lengthSquared <= 0.0f;
+		const float fixFactor = degenerate ? 1.0f : 1.0f / sqrtf(lengthSquared);
+		w = degenerate ? 1.0f : w * fixFactor;
+		x = degenerate ? 0.0f : x * fixFactor;
+		y = degenerate ? 0.0f : y * fixFactor;
+		z = degenerate ? 0.0f : z * fixFactor;
+	}
+
+	inline void PoolAngleAxis(float inAngle, float inX, float inY, float inZ, float& w, float& x, float& y, float& z)
+	{
+		w = Cos(inAngle * 0.5f);
+		x = inX;
+		y = inY;
+		z = inZ;
+		PoolQuatNormalize(w, x, y, z);
+	}
+
+	// same as Vec * Quat
+	inline void PoolRotate(float& vx, float& vy, float& vz, float qw, float qx, float qy, float qz)
+	{
+		float pw = 0.0f, px = vx, py = vy, pz = vz;
+		float tw = qw, tx = qx, ty = qy, tz = qz;
+		PoolQuatMultiply(tw, tx, ty, tz, pw, px, py, pz);
+		PoolQuatMultiply(tw, tx, ty, tz, qw, -qx, -qy, -qz);
+		vx = tx;
+		vy = ty;
+		vz = tz;
+	}
+
+	inline void PoolNormalizeVec(float& x, float& y, float& z)
+	{
+		const float length = sqrtf(x * x + y * y + z * z);
+		const float fixFactor = length == 0.0f ? 1.0f : 1.0f / length;
+		x = length == 0.0f ? x : x * fixFactor;
+		y = length == 0.0f ? y : y * fixFactor;
+		z = length == 0.0f ? z : z * fixFactor;
+	}
+} // namespace GamepadMotionHelpers
+
+template<int MaxControllers>
+GamepadMotionPool<MaxControllers>::GamepadMotionPool()
+{
+	SharedSettingsProfile = nullptr;
+	for (int controller = 0; controller < MaxControllers; controller++)
+	{
+		IsCalibrating[controller] = false;
+		CurrentCalibrationMode[controller] = GamepadMotionHelpers::CalibrationMode::Manual;
+		AutoCalibration[controller].SetCalibrationData(&ScratchCalibration);
+		AutoCalibration[controller].SetSettings(&OwnSettingsProfile);
+		Pending[controller] = 0;
+		TimeCorrecting[controller] = 0.f;
+	}
+	ScratchCalibration = {};
+	NumPending = 0;
+	PendingEnd = 0;
+	Reset();
+}
+
+template<int MaxControllers>
+GamepadMotionPool<MaxControllers>::GamepadMotionPool(const GamepadMotionPool& other)
+{
+	CopyState(other);
+}
+
+template<int MaxControllers>
+GamepadMotionPool<MaxControllers>::GamepadMotionPool(GamepadMotionPool&& other) noexcept
+{
+	CopyState(other);
+}
+
+template<int MaxControllers>
+GamepadMotionPool<MaxControllers>& GamepadMotionPool<MaxControllers>::operator=(const GamepadMotionPool& other)
+{
+	if (this != &other)
+	{
+		CopyState(other);
+	}
+	return *this;
+}
+
+template<int MaxControllers>
+GamepadMotionPool<MaxControllers>& GamepadMotionPool<MaxControllers>::operator=(GamepadMotionPool&& other) noexcept
+{
+	if (this != &other)
+	{
+		CopyState(other);
+	}
+	return *this;
+}
+
+// everything, with each auto-calibration and the settings pointed back at this pool
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::CopyState(const GamepadMotionPool& other)
+{
+	Settings = other.Settings;
+	OwnSettingsProfile = other.OwnSettingsProfile;
+	SharedSettingsProfile = other.SharedSettingsProfile;
+	for (int controller = 0; controller < MaxControllers; controller++)
+	{
+		InGyroX[controller] = other.InGyroX[controller];
+		InGyroY[controller] = other.InGyroY[controller];
+		InGyroZ[controller] = other.InGyroZ[controller];
+		InAccelX[controller] = other.InAccelX[controller];
+		InAccelY[controller] = other.InAccelY[controller];
+		InAccelZ[controller] = other.InAccelZ[controller];
+		InDeltaTime[controller] = other.InDeltaTime[controller];
+		Pending[controller] = other.Pending[controller];
+		GyroX[controller] = other.GyroX[controller];
+		GyroY[controller] = other.GyroY[controller];
+		GyroZ[controller] = other.GyroZ[controller];
+		GravityLength[controller] = other.GravityLength[controller];
+		QuatW[controller] = other.QuatW[controller];
+		QuatX[controller] = other.QuatX[controller];
+		QuatY[controller] = other.QuatY[controller];
+		QuatZ[controller] = other.QuatZ[controller];
+		AccelX[controller] = other.AccelX[controller];
+		AccelY[controller] = other.AccelY[controller];
+		AccelZ[controller] = other.AccelZ[controller];
+		GravX[controller] = other.GravX[controller];
+		GravY[controller] = other.GravY[controller];
+		GravZ[controller] = other.GravZ[controller];
+		ShortSmoothAccelX[controller] = other.ShortSmoothAccelX[controller];
+		ShortSmoothAccelY[controller] = other.ShortSmoothAccelY[controller];
+		ShortSmoothAccelZ[controller] = other.ShortSmoothAccelZ[controller];
+		LongSmoothAccelX[controller] = other.LongSmoothAccelX[controller];
+		LongSmoothAccelY[controller] = other.LongSmoothAccelY[controller];
+		LongSmoothAccelZ[controller] = other.LongSmoothAccelZ[controller];
+		TimeCorrecting[controller] = other.TimeCorrecting[controller];
+		CalibrationX[controller] = other.CalibrationX[controller];
+		CalibrationY[controller] = other.CalibrationY[controller];
+		CalibrationZ[controller] = other.CalibrationZ[controller];
+		CalibrationAccelMagnitude[controller] = other.CalibrationAccelMagnitude[controller];
+		CalibrationNumSamples[controller] = other.CalibrationNumSamples[controller];
+		CurrentCalibrationMode[controller] = other.CurrentCalibrationMode[controller];
+		IsCalibrating[controller] = other.IsCalibrating[controller];
+		AutoCalibration[controller] = other.AutoCalibration[controller];
+		AutoCalibration[controller].SetCalibrationData(&ScratchCalibration);
+	}
+	ScratchCalibration = other.ScratchCalibration;
+	NumPending = other.NumPending;
+	PendingEnd = other.PendingEnd;
+	SetSettingsProfile(SharedSettingsProfile);
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::Reset()
+{
+	Settings = GamepadMotionSettings();
+	for (int controller = 0; controller < MaxControllers; controller++)
+	{
+		Reset(controller);
+	}
+	PendingEnd = 0;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::Reset(int controller)
+{
+	InGyroX[controller] = InGyroY[controller] = InGyroZ[controller] = 0.f;
+	InAccelX[controller] = InAccelY[controller] = InAccelZ[controller] = 0.f;
+	InDeltaTime[controller] = 0.f;
+	if (Pending[controller] != 0)
+	{
+		Pending[controller] = 0;
+		NumPending--;
+	}
+	GyroX[controller] = GyroY[controller] = GyroZ[controller] = 0.f;
+	GravityLength[controller] = 0.f;
+	ResetContinuousCalibration(controller);
+	ResetMotion(controller);
+}
+
+template<int MaxControllers>
+bool GamepadMotionPool<MaxControllers>::QueueMotion(int controller, float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime)
+{
+	if (controller < 0 || controller >= MaxControllers || Pending[controller] != 0)
+	{
+		return false;
+	}
+
+	InGyroX[controller] = gyroX;
+	InGyroY[controller] = gyroY;
+	InGyroZ[controller] = gyroZ;
+	InAccelX[controller] = accelX;
+	InAccelY[controller] = accelY;
+	InAccelZ[controller] = accelZ;
+	InDeltaTime[controller] = deltaTime;
+	Pending[controller] = 1;
+	NumPending++;
+	PendingEnd = std::max(PendingEnd, controller + 1);
+	return true;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::ProcessMotion()
+{
+	if (NumPending == 0)
+	{
+		return;
+	}
+
+	// only work out derived settings again if Settings has been changed
+	if (SharedSettingsProfile == nullptr && memcmp(&OwnSettingsProfile.GetSettings(), &Settings, sizeof(GamepadMotionSettings)) != 0)
+	{
+		OwnSettingsProfile.SetSettings(Settings);
+	}
+
+	// calibration is branchy and per-controller, so do that first for each queued controller
+	for (int controller = 0; controller < PendingEnd; controller++)
+	{
+		if (Pending[controller] != 0)
+		{
+			CalibrateQueued(controller);
 		}
+	}
+
+	// then update motion for every queued controller in one pass
+	UpdateMotionQueued(PendingEnd);
+
+	for (int controller = 0; controller < PendingEnd; controller++)
+	{
+		Pending[controller] = 0;
+	}
+	NumPending = 0;
+	PendingEnd = 0;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile)
+{
+	SharedSettingsProfile = settingsProfile;
+	const GamepadMotionSettingsProfile* activeProfile = GetActiveSettingsProfile();
+	for (int controller = 0; controller < MaxControllers; controller++)
+	{
+		AutoCalibration[controller].SetSettings(activeProfile);
+	}
+}
+
+template<int MaxControllers>
+const GamepadMotionSettingsProfile* GamepadMotionPool<MaxControllers>::GetSettingsProfile()
+{
+	return SharedSettingsProfile;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::SaveSnapshot(int controller, GamepadMotionSnapshot& outSnapshot)
+{
+	outSnapshot = GamepadMotionSnapshot{};
+	outSnapshot.Version = GamepadMotionSnapshot::CurrentVersion;
+	outSnapshot.Size = (int)sizeof(GamepadMotionSnapshot);
+	outSnapshot.Settings = Settings;
+	outSnapshot.GyroCalibration.X = CalibrationX[controller];
+	outSnapshot.GyroCalibration.Y = CalibrationY[controller];
+	outSnapshot.GyroCalibration.Z = CalibrationZ[controller];
+	outSnapshot.GyroCalibration.AccelMagnitude = CalibrationAccelMagnitude[controller];
+	outSnapshot.GyroCalibration.NumSamples = CalibrationNumSamples[controller];
+
+	GamepadMotionHelpers::MotionSnapshot& motion = outSnapshot.Motion;
+	motion.Quaternion[0] = QuatW[controller];
+	motion.Quaternion[1] = QuatX[controller];
+	motion.Quaternion[2] = QuatY[controller];
+	motion.Quaternion[3] = QuatZ[controller];
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(AccelX[controller], AccelY[controller], AccelZ[controller]), motion.Accel);
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(GravX[controller], GravY[controller], GravZ[controller]), motion.Grav);
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(ShortSmoothAccelX[controller], ShortSmoothAccelY[controller], ShortSmoothAccelZ[controller]), motion.ShortSmoothAccel);
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(LongSmoothAccelX[controller], LongSmoothAccelY[controller], LongSmoothAccelZ[controller]), motion.LongSmoothAccel);
+	motion.TimeCorrecting = TimeCorrecting[controller];
+
+	AutoCalibration[controller].SaveSnapshot(outSnapshot.AutoCalibration);
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(GyroX[controller], GyroY[controller], GyroZ[controller]), outSnapshot.Gyro);
+	GamepadMotionHelpers::StoreVec(GamepadMotionHelpers::Vec(InAccelX[controller], InAccelY[controller], InAccelZ[controller]), outSnapshot.RawAccel);
+	outSnapshot.CalibrationMode = (int)CurrentCalibrationMode[controller];
+	outSnapshot.IsCalibrating = IsCalibrating[controller] ? 1 : 0;
+}
+
+template<int MaxControllers>
+bool GamepadMotionPool<MaxControllers>::LoadSnapshot(int controller, const GamepadMotionSnapshot& snapshot)
+{
+	if (snapshot.Version != GamepadMotionSnapshot::CurrentVersion || snapshot.Size != (int)sizeof(GamepadMotionSnapshot) ||
+		!GamepadMotionHelpers::AutoCalibration::IsValidSnapshot(snapshot.AutoCalibration))
+	{
+		return false;
+	}
+
+	CalibrationX[controller] = snapshot.GyroCalibration.X;
+	CalibrationY[controller] = snapshot.GyroCalibration.Y;
+	CalibrationZ[controller] = snapshot.GyroCalibration.Z;
+	CalibrationAccelMagnitude[controller] = snapshot.GyroCalibration.AccelMagnitude;
+	CalibrationNumSamples[controller] = snapshot.GyroCalibration.NumSamples;
+
+	const GamepadMotionHelpers::MotionSnapshot& motion = snapshot.Motion;
+	QuatW[controller] = motion.Quaternion[0];
+	QuatX[controller] = motion.Quaternion[1];
+	QuatY[controller] = motion.Quaternion[2];
+	QuatZ[controller] = motion.Quaternion[3];
+	AccelX[controller] = motion.Accel[0];
+	AccelY[controller] = motion.Accel[1];
+	AccelZ[controller] = motion.Accel[2];
+	GravX[controller] = motion.Grav[0];
+	GravY[controller] = motion.Grav[1];
+	GravZ[controller] = motion.Grav[2];
+	ShortSmoothAccelX[controller] = motion.ShortSmoothAccel[0];
+	ShortSmoothAccelY[controller] = motion.ShortSmoothAccel[1];
+	ShortSmoothAccelZ[controller] = motion.ShortSmoothAccel[2];
+	LongSmoothAccelX[controller] = motion.LongSmoothAccel[0];
+	LongSmoothAccelY[controller] = motion.LongSmoothAccel[1];
+	LongSmoothAccelZ[controller] = motion.LongSmoothAccel[2];
+	TimeCorrecting[controller] = motion.TimeCorrecting;
+
+	AutoCalibration[controller].LoadSnapshot(snapshot.AutoCalibration);
+	GyroX[controller] = snapshot.Gyro[0];
+	GyroY[controller] = snapshot.Gyro[1];
+	GyroZ[controller] = snapshot.Gyro[2];
+	CurrentCalibrationMode[controller] = (GamepadMotionHelpers::CalibrationMode)snapshot.CalibrationMode;
+	IsCalibrating[controller] = snapshot.IsCalibrating != 0;
+	return true;
+}
+
+template<int MaxControllers>
+const GamepadMotionSettingsProfile* GamepadMotionPool<MaxControllers>::GetActiveSettingsProfile()
+{
+	return SharedSettingsProfile != nullptr ? SharedSettingsProfile : &OwnSettingsProfile;
+}
 
-		if (CurrentCalibrationMode & GamepadMotionHelpers::CalibrationMode::Stillness)
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::CalibrateQueued(int controller)
+{
+	const float gyroX = InGyroX[controller];
+	const float gyroY = InGyroY[controller];
+	const float gyroZ = InGyroZ[controller];
+	const float accelX = InAccelX[controller];
+	const float accelY = InAccelY[controller];
+	const float accelZ = InAccelZ[controller];
+	const float deltaTime = InDeltaTime[controller];
+	GamepadMotionHelpers::AutoCalibration& autoCalibration = AutoCalibration[controller];
+
+	if (IsCalibrating[controller])
+	{
+		// manual calibration
+		CalibrationNumSamples[controller]++;
+		CalibrationX[controller] += gyroX;
+		CalibrationY[controller] += gyroY;
+		CalibrationZ[controller] += gyroZ;
+		CalibrationAccelMagnitude[controller] += sqrtf(accelX * accelX + accelY * accelY + accelZ * accelZ);
+		autoCalibration.NoSampleSensorFusion();
+		autoCalibration.NoSampleStillness();
+	}
+	else
+	{
+		const GamepadMotionHelpers::CalibrationMode mode = CurrentCalibrationMode[controller];
+		if (mode == GamepadMotionHelpers::CalibrationMode::Manual)
 		{
-			AutoCalibration.AddSampleStillness(GamepadMotionHelpers::Vec(gyroX, gyroY, gyroZ), GamepadMotionHelpers::Vec(accelX, accelY, accelZ), vecMask, deltaTime);
+			autoCalibration.NoSampleSensorFusion();
+			autoCalibration.NoSampleStillness();
 		}
 		else
 		{
-			AutoCalibration.NoSampleStillness();
+			ScratchCalibration.X = CalibrationX[controller];
+			ScratchCalibration.Y = CalibrationY[controller];
+			ScratchCalibration.Z = CalibrationZ[controller];
+			ScratchCalibration.AccelMagnitude = CalibrationAccelMagnitude[controller];
+			ScratchCalibration.NumSamples = CalibrationNumSamples[controller];
+
+			// we only calibrate in axes that haven't already been calibrated by a previous step. To start, we're calibrating in All axes.
+			GamepadMotionHelpers::Vec vecMask = GamepadMotionHelpers::Vec(1.f);
+			const GamepadMotionHelpers::Vec gyro = GamepadMotionHelpers::Vec(gyroX, gyroY, gyroZ);
+			const GamepadMotionHelpers::Vec accel = GamepadMotionHelpers::Vec(accelX, accelY, accelZ);
+
+			if (mode & GamepadMotionHelpers::CalibrationMode::SensorFusion)
+			{
+				autoCalibration.AddSampleSensorFusion(gyro, accel, vecMask, deltaTime);
+			}
+			else
+			{
+				autoCalibration.NoSampleSensorFusion();
+			}
+
+			if (mode & GamepadMotionHelpers::CalibrationMode::Stillness)
+			{
+				autoCalibration.AddSampleStillness(gyro, accel, vecMask, deltaTime);
+			}
+			else
+			{
+				autoCalibration.NoSampleStillness();
+			}
+
+			CalibrationX[controller] = ScratchCalibration.X;
+			CalibrationY[controller] = ScratchCalibration.Y;
+			CalibrationZ[controller] = ScratchCalibration.Z;
+			CalibrationAccelMagnitude[controller] = ScratchCalibration.AccelMagnitude;
+			CalibrationNumSamples[controller] = ScratchCalibration.NumSamples;
 		}
 	}
 
-	float gyroOffsetX, gyroOffsetY, gyroOffsetZ;
-	GetCalibratedSensor(gyroOffsetX, gyroOffsetY, gyroOffsetZ, accelMagnitude);
+	float gyroOffsetX, gyroOffsetY, gyroOffsetZ, accelMagnitude;
+	GetCalibrationOffset(controller, gyroOffsetX, gyroOffsetY, gyroOffsetZ);
+	accelMagnitude = CalibrationNumSamples[controller] <= 0 ? 0.f : CalibrationAccelMagnitude[controller] * (1.f / CalibrationNumSamples[controller]);
+
+	GyroX[controller] = gyroX - gyroOffsetX;
+	GyroY[controller] = gyroY - gyroOffsetY;
+	GyroZ[controller] = gyroZ - gyroOffsetZ;
+	GravityLength[controller] = accelMagnitude;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::UpdateMotionQueued(int end)
+{
+	using namespace GamepadMotionHelpers;
+
+	// get settings
+	const GamepadMotionSettingsProfile* settingsProfile = GetActiveSettingsProfile();
+	const float steadyGravityThresholdSquared = settingsProfile->SteadyGravityThresholdSquared;
+	const float gravityCorrectEaseInTime = settingsProfile->GetSettings().GravityCorrectEaseInTime;
+	const float gravityCorrectInverseEaseInTime = settingsProfile->GravityCorrectInverseEaseInTime;
+	const float gravityCorrectInverseHalfTime = settingsProfile->GravityCorrectInverseHalfTime;
+	const float gravityCorrectMinAngleCosSquared = settingsProfile->GravityCorrectMinAngleCosSquared;
+	// a half time of 0 corrects all the way at once. Scaling by this, rather than choosing in the loop, keeps the loop
+	// free of branches
+	const float correctFactorScale = gravityCorrectInverseHalfTime <= 0.f ? 0.f : 1.f;
+
+	// everything in here matches Motion::Update, but with branches turned into selects so that every controller does
+	// the same work. Results are only written back for controllers with a queued sample. Conditions are combined with &
+	// and | rather than && and ||, and both sides of each select are worked out first, so that there's no control flow
+	// in the loop. GCC then vectorises it, as long as the maths functions are the approximations (GAMEPADMOTION_FAST_MATH
+	// or GAMEPADMOTION_DETERMINISTIC) and errno and floating point traps don't have to be preserved (-fno-math-errno
+	// -fno-trapping-math, both implied by -ffast-math)
+	for (int i = 0; i < end; i++)
+	{
+		const bool queued = Pending[i] != 0;
+		const float gyroX = GyroX[i];
+		const float gyroY = GyroY[i];
+		const float gyroZ = GyroZ[i];
+		const float accelX = InAccelX[i];
+		const float accelY = InAccelY[i];
+		const float accelZ = InAccelZ[i];
+		const float deltaTime = InDeltaTime[i];
+		const float gravityLength = GravityLength[i];
+
+		float angle = sqrtf(gyroX * gyroX + gyroY * gyroY + gyroZ * gyroZ) * (float)M_PI / 180.0f;
+		angle *= deltaTime;
+
+		// rotate
+		float rotationW, rotationX, rotationY, rotationZ;
+		PoolAngleAxis(angle, gyroX, gyroY, gyroZ, rotationW, rotationX, rotationY, rotationZ);
+		float quatW = QuatW[i], quatX = QuatX[i], quatY = QuatY[i], quatZ = QuatZ[i];
+		PoolQuatMultiply(quatW, quatX, quatY, quatZ, rotationW, rotationX, rotationY, rotationZ);
+
+		const float accelMagnitude = sqrtf(accelX * accelX + accelY * accelY + accelZ * accelZ);
+		const bool hasAccel = accelMagnitude > 0.0f;
+
+		// for comparing and smoothing gravity samples, we need them to be global
+		float absoluteAccelX = accelX, absoluteAccelY = accelY, absoluteAccelZ = accelZ;
+		PoolRotate(absoluteAccelX, absoluteAccelY, absoluteAccelZ, quatW, quatX, quatY, quatZ);
+		const float shortSmoothFactor = ShortSteadinessHalfTime <= 0.f ? 0.f : Exp2(-deltaTime / ShortSteadinessHalfTime);
+		const float shortSmoothX = absoluteAccelX + (ShortSmoothAccelX[i] - absoluteAccelX) * shortSmoothFactor;
+		const float shortSmoothY = absoluteAccelY + (ShortSmoothAccelY[i] - absoluteAccelY) * shortSmoothFactor;
+		const float shortSmoothZ = absoluteAccelZ + (ShortSmoothAccelZ[i] - absoluteAccelZ) * shortSmoothFactor;
+		const float longSmoothFactor = LongSteadinessHalfTime <= 0.f ? 0.f : Exp2(-deltaTime / LongSteadinessHalfTime);
+		const float longSmoothX = absoluteAccelX + (LongSmoothAccelX[i] - absoluteAccelX) * longSmoothFactor;
+		const float longSmoothY = absoluteAccelY + (LongSmoothAccelY[i] - absoluteAccelY) * longSmoothFactor;
+		const float longSmoothZ = absoluteAccelZ + (LongSmoothAccelZ[i] - absoluteAccelZ) * longSmoothFactor;
+
+		const float steadyX = longSmoothX - shortSmoothX;
+		const float steadyY = longSmoothY - shortSmoothY;
+		const float steadyZ = longSmoothZ - shortSmoothZ;
+		const bool steady = hasAccel & (steadyX * steadyX + steadyY * steadyY + steadyZ * steadyZ <= steadyGravityThresholdSquared);
+		const float timeCorrecting = steady ? TimeCorrecting[i] + deltaTime : 0.0f;
+
+		// gravity correction, skipped when it's close enough already. Both the small-angle and full corrections are worked
+		// out, and the right one picked
+		const float accelLengthSquared = shortSmoothX * shortSmoothX + shortSmoothY * shortSmoothY + shortSmoothZ * shortSmoothZ;
+		const float upAccelSquared = shortSmoothY * shortSmoothY;
+		const bool closeEnough = (shortSmoothY > 0.0f) & (upAccelSquared >= gravityCorrectMinAngleCosSquared * accelLengthSquared);
+		const bool smallError = (shortSmoothY > 0.0f) & (upAccelSquared >= Motion::SmallGravityErrorCosSquared * accelLengthSquared);
+
+		const float correctFactor = Exp2(-deltaTime * gravityCorrectInverseHalfTime) * correctFactorScale;
+		float correctAmount = 1.0f - correctFactor;
+		correctAmount = timeCorrecting < gravityCorrectEaseInTime ? correctAmount * (timeCorrecting * gravityCorrectInverseEaseInTime) : correctAmount;
+
+		float gravityDirectionX = shortSmoothX, gravityDirectionY = shortSmoothY, gravityDirectionZ = shortSmoothZ;
+		PoolNormalizeVec(gravityDirectionX, gravityDirectionY, gravityDirectionZ);
+		gravityDirectionX = -gravityDirectionX;
+		gravityDirectionY = -gravityDirectionY;
+		gravityDirectionZ = -gravityDirectionZ;
+		const float errorAxisX = gravityDirectionY * 0.0f - gravityDirectionZ * -1.0f;
+		const float errorAxisY = gravityDirectionZ * 0.0f - gravityDirectionX * 0.0f;
+		const float errorAxisZ = gravityDirectionX * -1.0f - gravityDirectionY * 0.0f;
+
+		const float halfCorrectX = errorAxisX * (0.5f * correctAmount);
+		const float halfCorrectY = errorAxisY * (0.5f * correctAmount);
+		const float halfCorrectZ = errorAxisZ * (0.5f * correctAmount);
+		const float smallCorrectionW = 1.0f - 0.5f * (halfCorrectX * halfCorrectX + halfCorrectY * halfCorrectY + halfCorrectZ * halfCorrectZ);
+
+		const float errorAngle = Acos(0.0f * gravityDirectionX + -1.0f * gravityDirectionY + 0.0f * gravityDirectionZ);
+		float flattenedX = errorAxisX, flattenedY = errorAxisY, flattenedZ = errorAxisZ;
+		PoolNormalizeVec(flattenedX, flattenedY, flattenedZ);
+		const float halfCorrectAngle = errorAngle * correctAmount * 0.5f;
+		const float sinHalfCorrectAngle = Sin(halfCorrectAngle);
+		const float cosHalfCorrectAngle = Cos(halfCorrectAngle);
+
+		float correctionW = smallError ? smallCorrectionW : cosHalfCorrectAngle;
+		float correctionX = smallError ? halfCorrectX : flattenedX * sinHalfCorrectAngle;
+		float correctionY = smallError ? halfCorrectY : flattenedY * sinHalfCorrectAngle;
+		float correctionZ = smallError ? halfCorrectZ : flattenedZ * sinHalfCorrectAngle;
+		PoolQuatMultiply(correctionW, correctionX, correctionY, correctionZ, quatW, quatX, quatY, quatZ);
+		const bool correct = steady & !closeEnough & (smallError | (errorAngle > 0.0f));
+		quatW = correct ? correctionW : quatW;
+		quatX = correct ? correctionX : quatX;
+		quatY = correct ? correctionY : quatY;
+		quatZ = correct ? correctionZ : quatZ;
+
+		float gravX = 0.0f, gravY = -gravityLength, gravZ = 0.0f;
+		PoolRotate(gravX, gravY, gravZ, quatW, -quatX, -quatY, -quatZ);
+
+		PoolQuatRenormalize(quatW, quatX, quatY, quatZ);
+
+		// write back
+		const bool update = queued & hasAccel;
+		QuatW[i] = queued ? quatW : QuatW[i];
+		QuatX[i] = queued ? quatX : QuatX[i];
+		QuatY[i] = queued ? quatY : QuatY[i];
+		QuatZ[i] = queued ? quatZ : QuatZ[i];
+		ShortSmoothAccelX[i] = update ? shortSmoothX : ShortSmoothAccelX[i];
+		ShortSmoothAccelY[i] = update ? shortSmoothY : ShortSmoothAccelY[i];
+		ShortSmoothAccelZ[i] = update ? shortSmoothZ : ShortSmoothAccelZ[i];
+		LongSmoothAccelX[i] = update ? longSmoothX : LongSmoothAccelX[i];
+		LongSmoothAccelY[i] = update ? longSmoothY : LongSmoothAccelY[i];
+		LongSmoothAccelZ[i] = update ? longSmoothZ : LongSmoothAccelZ[i];
+		GravX[i] = update ? gravX : GravX[i];
+		GravY[i] = update ? gravY : GravY[i];
+		GravZ[i] = update ? gravZ : GravZ[i];
+		AccelX[i] = update ? accelX + gravX : (queued ? 0.0f : AccelX[i]);
+		AccelY[i] = update ? accelY + gravY : (queued ? 0.0f : AccelY[i]);
+		AccelZ[i] = update ? accelZ + gravZ : (queued ? 0.0f : AccelZ[i]);
+		TimeCorrecting[i] = queued ? timeCorrecting : TimeCorrecting[i];
+	}
+}
+
+// reading the current state
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::GetCalibratedGyro(int controller, float& x, float& y, float& z)
+{
+	x = GyroX[controller];
+	y = GyroY[controller];
+	z = GyroZ[controller];
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::GetGravity(int controller, float& x, float& y, float& z)
+{
+	x = GravX[controller];
+	y = GravY[controller];
+	z = GravZ[controller];
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::GetProcessedAcceleration(int controller, float& x, float& y, float& z)
+{
+	x = AccelX[controller];
+	y = AccelY[controller];
+	z = AccelZ[controller];
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::GetOrientation(int controller, float& w, float& x, float& y, float& z)
+{
+	w = QuatW[controller];
+	x = QuatX[controller];
+	y = QuatY[controller];
+	z = QuatZ[controller];
+}
+
+// gyro calibration functions
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::StartContinuousCalibration(int controller)
+{
+	IsCalibrating[controller] = true;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::PauseContinuousCalibration(int controller)
+{
+	IsCalibrating[controller] = false;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::ResetContinuousCalibration(int controller)
+{
+	CalibrationX[controller] = 0.f;
+	CalibrationY[controller] = 0.f;
+	CalibrationZ[controller] = 0.f;
+	CalibrationAccelMagnitude[controller] = 0.f;
+	CalibrationNumSamples[controller] = 0;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::GetCalibrationOffset(int controller, float& xOffset, float& yOffset, float& zOffset)
+{
+	if (CalibrationNumSamples[controller] <= 0)
+	{
+		xOffset = 0.f;
+		yOffset = 0.f;
+		zOffset = 0.f;
+		return;
+	}
+
+	const float inverseSamples = 1.f / CalibrationNumSamples[controller];
+	xOffset = CalibrationX[controller] * inverseSamples;
+	yOffset = CalibrationY[controller] * inverseSamples;
+	zOffset = CalibrationZ[controller] * inverseSamples;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::SetCalibrationOffset(int controller, float xOffset, float yOffset, float zOffset, int weight)
+{
+	if (CalibrationNumSamples[controller] > 1)
+	{
+		CalibrationAccelMagnitude[controller] *= ((float)weight) / CalibrationNumSamples[controller];
+	}
+	else
+	{
+		CalibrationAccelMagnitude[controller] = (float)weight;
+	}
+
+	CalibrationNumSamples[controller] = weight;
+	CalibrationX[controller] = xOffset * weight;
+	CalibrationY[controller] = yOffset * weight;
+	CalibrationZ[controller] = zOffset * weight;
+}
+
+template<int MaxControllers>
+GamepadMotionHelpers::CalibrationMode GamepadMotionPool<MaxControllers>::GetCalibrationMode(int controller)
+{
+	return CurrentCalibrationMode[controller];
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::SetCalibrationMode(int controller, GamepadMotionHelpers::CalibrationMode calibrationMode)
+{
+	CurrentCalibrationMode[controller] = calibrationMode;
+}
+
+template<int MaxControllers>
+void GamepadMotionPool<MaxControllers>::ResetMotion(int controller)
+{
+	QuatW[controller] = 1.f;
+	QuatX[controller] = QuatY[controller] = QuatZ[controller] = 0.f;
+	AccelX[controller] = AccelY[controller] = AccelZ[controller] = 0.f;
+	GravX[controller] = GravY[controller] = GravZ[controller] = 0.f;
+	ShortSmoothAccelX[controller] = ShortSmoothAccelY[controller] = ShortSmoothAccelZ[controller] = 0.f;
+	LongSmoothAccelX[controller] = LongSmoothAccelY[controller] = LongSmoothAccelZ[controller] = 0.f;
+}
+
+// BasicGamepadMotion
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+BasicGamepadMotion<CalibrationModes, Features>::BasicGamepadMotion()
+{
+	IsCalibrating = false;
+	SharedSettingsProfile = nullptr;
+	Reset();
+	if constexpr (HasAutoCalibration)
+	{
+		AutoCalibration.SetCalibrationData(&GyroCalibration);
+	}
+	SetSettingsProfile(nullptr);
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+BasicGamepadMotion<CalibrationModes, Features>::BasicGamepadMotion(const BasicGamepadMotion& other)
+{
+	CopyState(other);
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+BasicGamepadMotion<CalibrationModes, Features>::BasicGamepadMotion(BasicGamepadMotion&& other) noexcept
+{
+	CopyState(other);
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+BasicGamepadMotion<CalibrationModes, Features>& BasicGamepadMotion<CalibrationModes, Features>::operator=(const BasicGamepadMotion& other)
+{
+	if (this != &other)
+	{
+		CopyState(other);
+	}
+	return *this;
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+BasicGamepadMotion<CalibrationModes, Features>& BasicGamepadMotion<CalibrationModes, Features>::operator=(BasicGamepadMotion&& other) noexcept
+{
+	if (this != &other)
+	{
+		CopyState(other);
+	}
+	return *this;
+}
+
+// everything, with calibration and settings pointed back at this object
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::CopyState(const BasicGamepadMotion& other)
+{
+	Settings = other.Settings;
+	OwnSettingsProfile = other.OwnSettingsProfile;
+	SharedSettingsProfile = other.SharedSettingsProfile;
+	Gyro = other.Gyro;
+	Motion = other.Motion;
+	GyroCalibration = other.GyroCalibration;
+	AutoCalibration = other.AutoCalibration;
+	IsCalibrating = other.IsCalibrating;
+
+	if constexpr (HasAutoCalibration)
+	{
+		AutoCalibration.SetCalibrationData(&GyroCalibration);
+	}
+	SetSettingsProfile(SharedSettingsProfile);
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::Reset()
+{
+	GyroCalibration = {};
+	Gyro = {};
+	Settings = GamepadMotionSettings();
+	if constexpr (HasOrientation)
+	{
+		Motion.Reset();
+	}
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::ProcessMotion(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime)
+{
+	UpdateSettingsProfile();
+	ProcessMotionStep(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime);
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::ProcessMotionBatch(const GamepadMotionHelpers::MotionSample* samples, int numSamples,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	if (samples == nullptr || numSamples <= 0)
+	{
+		return;
+	}
+
+	UpdateSettingsProfile();
+	for (int i = 0; i < numSamples; i++)
+	{
+		const GamepadMotionHelpers::MotionSample& sample = samples[i];
+		ProcessMotionStep(sample.GyroX, sample.GyroY, sample.GyroZ, sample.AccelX, sample.AccelY, sample.AccelZ, sample.DeltaTime);
 
-	gyroX -= gyroOffsetX;
-	gyroY -= gyroOffsetY;
-	gyroZ -= gyroOffsetZ;
+		if (outCalibratedGyro != nullptr)
+		{
+			outCalibratedGyro[0] = Gyro.x;
+			outCalibratedGyro[1] = Gyro.y;
+			outCalibratedGyro[2] = Gyro.z;
+			outCalibratedGyro += 3;
+		}
 
-	Motion.Update(gyroX, gyroY, gyroZ, accelX, accelY, accelZ, accelMagnitude, deltaTime);
+		if constexpr (HasOrientation)
+		{
+			if (outOrientation != nullptr)
+			{
+				GetOrientation(outOrientation[0], outOrientation[1], outOrientation[2], outOrientation[3]);
+				outOrientation += 4;
+			}
+		}
+	}
+}
 
-	Gyro.x = gyroX;
-	Gyro.y = gyroY;
-	Gyro.z = gyroZ;
-	RawAccel.x = accelX;
-	RawAccel.y = accelY;
-	RawAccel.z = accelZ;
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::ProcessMotionStep(float gyroX, float gyroY, float gyroZ,
+	float accelX, float accelY, float accelZ, float deltaTime)
+{
+	if (IsCalibrating)
+	{
+		GamepadMotionHelpers::MotionStep::Process<true, false, false>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, nullptr);
+	}
+	else
+	{
+		GamepadMotionHelpers::MotionStep::Process<false, HasSensorFusion, HasStillness>(*this, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, deltaTime, nullptr);
+	}
 }
 
 // reading the current state
-void GamepadMotion::GetCalibratedGyro(float& x, float& y, float& z)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetCalibratedGyro(float& x, float& y, float& z)
 {
 	x = Gyro.x;
 	y = Gyro.y;
 	z = Gyro.z;
 }
 
-void GamepadMotion::GetGravity(float& x, float& y, float& z)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetGravity(float& x, float& y, float& z)
 {
+	static_assert(HasOrientation, "GetGravity needs a BasicGamepadMotion built with MotionFeatures::Orientation");
+	Motion.ResolveGravity();
 	x = Motion.Grav.x;
 	y = Motion.Grav.y;
 	z = Motion.Grav.z;
 }
 
-void GamepadMotion::GetProcessedAcceleration(float& x, float& y, float& z)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetProcessedAcceleration(float& x, float& y, float& z)
 {
+	static_assert(HasProcessedAcceleration, "GetProcessedAcceleration needs a BasicGamepadMotion built with MotionFeatures::Orientation and MotionFeatures::ProcessedAcceleration");
+	Motion.ResolveGravity();
 	x = Motion.Accel.x;
 	y = Motion.Accel.y;
 	z = Motion.Accel.z;
 }
 
-void GamepadMotion::GetOrientation(float& w, float& x, float& y, float& z)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetOrientation(float& w, float& x, float& y, float& z)
 {
+	static_assert(HasOrientation, "GetOrientation needs a BasicGamepadMotion built with MotionFeatures::Orientation");
 	w = Motion.Quaternion.w;
 	x = Motion.Quaternion.x;
 	y = Motion.Quaternion.y;
@@ -1052,28 +4822,33 @@ void GamepadMotion::GetOrientation(float& w, float& x, float& y, float& z)
 }
 
 // gyro calibration functions
-void GamepadMotion::StartContinuousCalibration()
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::StartContinuousCalibration()
 {
 	IsCalibrating = true;
 }
 
-void GamepadMotion::PauseContinuousCalibration()
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::PauseContinuousCalibration()
 {
 	IsCalibrating = false;
 }
 
-void GamepadMotion::ResetContinuousCalibration()
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::ResetContinuousCalibration()
 {
 	GyroCalibration = {};
 }
 
-void GamepadMotion::GetCalibrationOffset(float& xOffset, float& yOffset, float& zOffset)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetCalibrationOffset(float& xOffset, float& yOffset, float& zOffset)
 {
 	float accelMagnitude;
 	GetCalibratedSensor(xOffset, yOffset, zOffset, accelMagnitude);
 }
 
-void GamepadMotion::SetCalibrationOffset(float xOffset, float yOffset, float zOffset, int weight)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::SetCalibrationOffset(float xOffset, float yOffset, float zOffset, int weight)
 {
 	if (GyroCalibration.NumSamples > 1)
 	{
@@ -1090,24 +4865,56 @@ void GamepadMotion::SetCalibrationOffset(float xOffset, float yOffset, float zOf
 	GyroCalibration.Z = zOffset * weight;
 }
 
-GamepadMotionHelpers::CalibrationMode GamepadMotion::GetCalibrationMode()
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+GamepadMotionHelpers::CalibrationMode BasicGamepadMotion<CalibrationModes, Features>::GetCalibrationMode()
 {
-	return CurrentCalibrationMode;
+	return CalibrationModes;
 }
 
-void GamepadMotion::SetCalibrationMode(GamepadMotionHelpers::CalibrationMode calibrationMode)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::ResetMotion()
 {
-	CurrentCalibrationMode = calibrationMode;
+	if constexpr (HasOrientation)
+	{
+		Motion.Reset();
+	}
 }
 
-void GamepadMotion::ResetMotion()
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::SetSettingsProfile(const GamepadMotionSettingsProfile* settingsProfile)
 {
-	Motion.Reset();
+	SharedSettingsProfile = settingsProfile;
+	const GamepadMotionSettingsProfile* activeProfile = settingsProfile != nullptr ? settingsProfile : &OwnSettingsProfile;
+	if constexpr (HasAutoCalibration)
+	{
+		AutoCalibration.SetSettings(activeProfile);
+	}
+	if constexpr (HasOrientation)
+	{
+		Motion.SetSettings(activeProfile);
+	}
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+const GamepadMotionSettingsProfile* BasicGamepadMotion<CalibrationModes, Features>::GetSettingsProfile()
+{
+	return SharedSettingsProfile;
 }
 
 // Private Methods
 
-void GamepadMotion::PushSensorSamples(float gyroX, float gyroY, float gyroZ, float accelMagnitude)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::UpdateSettingsProfile()
+{
+	// only work out derived settings again if Settings has been changed
+	if (SharedSettingsProfile == nullptr && memcmp(&OwnSettingsProfile.GetSettings(), &Settings, sizeof(GamepadMotionSettings)) != 0)
+	{
+		OwnSettingsProfile.SetSettings(Settings);
+	}
+}
+
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::PushSensorSamples(float gyroX, float gyroY, float gyroZ, float accelMagnitude)
 {
 	// accumulate
 	GyroCalibration.NumSamples++;
@@ -1117,7 +4924,8 @@ void GamepadMotion::PushSensorSamples(float gyroX, float gyroY, float gyroZ, flo
 	GyroCalibration.AccelMagnitude += accelMagnitude;
 }
 
-void GamepadMotion::GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY, float& gyroOffsetZ, float& accelMagnitude)
+template<GamepadMotionHelpers::CalibrationMode CalibrationModes, GamepadMotionHelpers::MotionFeatures Features>
+void BasicGamepadMotion<CalibrationModes, Features>::GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY, float& gyroOffsetZ, float& accelMagnitude)
 {
 	if (GyroCalibration.NumSamples <= 0)
 	{
@@ -1134,3 +4942,13 @@ void GamepadMotion::GetCalibratedSensor(float& gyroOffsetX, float& gyroOffsetY,
 	gyroOffsetZ = GyroCalibration.Z * inverseSamples;
 	accelMagnitude = GyroCalibration.AccelMagnitude * inverseSamples;
 }
+
+#if defined(GAMEPADMOTION_DETERMINISTIC)
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#elif defined(_MSC_VER)
+#pragma float_control(pop)
+#endif
+#endif
@@ -0,0 +1,182 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+// The C API in GamepadMotionC.h, built into the GamepadMotionHelpers_c shared library.
+#include "GamepadMotion.hpp"
+#include "GamepadMotionC.h"
+
+#include <new>
+
+static_assert(sizeof(GamepadMotionHelpers::MotionSample) == 7 * sizeof(float), "samples are passed to C as 7 floats");
+// a new setting changes the size, so this catches one that CopySettings doesn't copy yet
+static_assert(sizeof(GamepadMotionCSettings) == sizeof(GamepadMotionSettings), "GamepadMotionCSettings must match GamepadMotionSettings");
+
+namespace
+{
+	GamepadMotion* ToMotion(GamepadMotionHandle motion)
+	{
+		return reinterpret_cast<GamepadMotion*>(motion);
+	}
+
+	// either way between GamepadMotionSettings and GamepadMotionCSettings, by name, so fields can't get mixed up
+	template<typename To, typename From>
+	void CopySettings(To& to, const From& from)
+	{
+		to.MinStillnessSamples = from.MinStillnessSamples;
+		to.MinStillnessTime = from.MinStillnessTime;
+		to.MaxStillnessError = from.MaxStillnessError;
+		to.StillnessSampleDeteriorationRate = from.StillnessSampleDeteriorationRate;
+		to.StillnessErrorClimbRate = from.StillnessErrorClimbRate;
+		to.StillnessErrorDropOnRecalibrate = from.StillnessErrorDropOnRecalibrate;
+		to.StillnessCalibrationEaseInTime = from.StillnessCalibrationEaseInTime;
+		to.StillnessCalibrationHalfTime = from.StillnessCalibrationHalfTime;
+		to.StillnessWindowTime = from.StillnessWindowTime;
+		to.StillnessDetection = (decltype(to.StillnessDetection))from.StillnessDetection;
+
+		to.SensorFusionCalibrationSmoothingStrength = from.SensorFusionCalibrationSmoothingStrength;
+		to.SensorFusionAngularAccelerationThreshold = from.SensorFusionAngularAccelerationThreshold;
+		to.SensorFusionCalibrationEaseInTime = from.SensorFusionCalibrationEaseInTime;
+		to.SensorFusionCalibrationHalfTime = from.SensorFusionCalibrationHalfTime;
+
+		to.SteadyGravityThreshold = from.SteadyGravityThreshold;
+		to.GravityCorrectEaseInTime = from.GravityCorrectEaseInTime;
+		to.GravityCorrectHalfTime = from.GravityCorrectHalfTime;
+		to.GravityCorrectMinAngle = from.GravityCorrectMinAngle;
+
+		to.MagnetometerCorrectHalfTime = from.MagnetometerCorrectHalfTime;
+
+		to.GyroIntegration = (decltype(to.GyroIntegration))from.GyroIntegration;
+		to.OrientationNormalizeInterval = from.OrientationNormalizeInterval;
+	}
+}
+
+GamepadMotionHandle GamepadMotion_Create(void)
+{
+	return reinterpret_cast<GamepadMotionHandle>(new (std::nothrow) GamepadMotion());
+}
+
+void GamepadMotion_Destroy(GamepadMotionHandle motion)
+{
+	delete ToMotion(motion);
+}
+
+void GamepadMotion_Reset(GamepadMotionHandle motion)
+{
+	ToMotion(motion)->Reset();
+}
+
+void GamepadMotion_GetDefaultSettings(GamepadMotionCSettings* outSettings)
+{
+	CopySettings(*outSettings, GamepadMotionSettings());
+}
+
+void GamepadMotion_GetSettings(GamepadMotionHandle motion, GamepadMotionCSettings* outSettings)
+{
+	CopySettings(*outSettings, ToMotion(motion)->Settings);
+}
+
+void GamepadMotion_SetSettings(GamepadMotionHandle motion, const GamepadMotionCSettings* settings)
+{
+	CopySettings(ToMotion(motion)->Settings, *settings);
+}
+
+void GamepadMotion_SetCalibrationMode(GamepadMotionHandle motion, int32_t calibrationMode)
+{
+	ToMotion(motion)->SetCalibrationMode((GamepadMotionHelpers::CalibrationMode)calibrationMode);
+}
+
+void GamepadMotion_StartContinuousCalibration(GamepadMotionHandle motion)
+{
+	ToMotion(motion)->StartContinuousCalibration();
+}
+
+void GamepadMotion_PauseContinuousCalibration(GamepadMotionHandle motion)
+{
+	ToMotion(motion)->PauseContinuousCalibration();
+}
+
+void GamepadMotion_ResetContinuousCalibration(GamepadMotionHandle motion)
+{
+	ToMotion(motion)->ResetContinuousCalibration();
+}
+
+void GamepadMotion_SetCalibrationOffset(GamepadMotionHandle motion, float xOffset, float yOffset, float zOffset, int32_t weight)
+{
+	ToMotion(motion)->SetCalibrationOffset(xOffset, yOffset, zOffset, weight);
+}
+
+void GamepadMotion_SetTemperature(GamepadMotionHandle motion, float temperature)
+{
+	ToMotion(motion)->SetTemperature(temperature);
+}
+
+void GamepadMotion_ProcessMotion(GamepadMotionHandle motion, const float* samples, int32_t numSamples,
+	float* outCalibratedGyro, float* outOrientation)
+{
+	ToMotion(motion)->ProcessMotionBatch(reinterpret_cast<const GamepadMotionHelpers::MotionSample*>(samples), numSamples,
+		outCalibratedGyro, outOrientation);
+}
+
+void GamepadMotion_ProcessMotionMany(const GamepadMotionHandle* motions, int32_t numMotions,
+	const float* samples, const int32_t* numSamples)
+{
+	const GamepadMotionHelpers::MotionSample* nextSamples = reinterpret_cast<const GamepadMotionHelpers::MotionSample*>(samples);
+	for (int32_t motion = 0; motion < numMotions; motion++)
+	{
+		const int32_t count = numSamples[motion] > 0 ? numSamples[motion] : 0;
+		if (motions[motion] != nullptr)
+		{
+			ToMotion(motions[motion])->ProcessMotionBatch(nextSamples, count);
+		}
+		nextSamples += count;
+	}
+}
+
+void GamepadMotion_GetOutputs(const GamepadMotionHandle* motions, int32_t numMotions, GamepadMotionCOutputs* outOutputs)
+{
+	for (int32_t index = 0; index < numMotions; index++)
+	{
+		GamepadMotionCOutputs& outputs = outOutputs[index];
+		if (motions[index] == nullptr)
+		{
+			outputs = GamepadMotionCOutputs{};
+			continue;
+		}
+
+		GamepadMotion& motion = *ToMotion(motions[index]);
+		motion.GetCalibratedGyro(outputs.CalibratedGyro[0], outputs.CalibratedGyro[1], outputs.CalibratedGyro[2]);
+		motion.GetGravity(outputs.Gravity[0], outputs.Gravity[1], outputs.Gravity[2]);
+		motion.GetProcessedAcceleration(outputs.ProcessedAcceleration[0], outputs.ProcessedAcceleration[1], outputs.ProcessedAcceleration[2]);
+		motion.GetOrientation(outputs.Orientation[0], outputs.Orientation[1], outputs.Orientation[2], outputs.Orientation[3]);
+		motion.GetCalibrationOffset(outputs.CalibrationOffset[0], outputs.CalibrationOffset[1], outputs.CalibrationOffset[2]);
+		outputs.CalibrationMode = (int32_t)motion.GetCalibrationMode();
+		outputs.IsStill = motion.IsStill() ? 1 : 0;
+		outputs.IsGravitySteady = motion.IsGravitySteady() ? 1 : 0;
+		outputs.Changes = (int32_t)motion.ConsumeChanges();
+	}
+}
+
+int32_t GamepadMotion_GetSnapshotSize(void)
+{
+	return (int32_t)sizeof(GamepadMotionSnapshot);
+}
+
+void GamepadMotion_SaveSnapshot(GamepadMotionHandle motion, void* outBuffer)
+{
+	GamepadMotionSnapshot snapshot;
+	ToMotion(motion)->SaveSnapshot(snapshot);
+	memcpy(outBuffer, &snapshot, sizeof(snapshot));
+}
+
+int32_t GamepadMotion_LoadSnapshot(GamepadMotionHandle motion, const void* buffer, int32_t size)
+{
+	if (size != (int32_t)sizeof(GamepadMotionSnapshot))
+	{
+		return 0;
+	}
+
+	// copied first, since the caller's buffer needn't be aligned for a GamepadMotionSnapshot
+	GamepadMotionSnapshot snapshot;
+	memcpy(&snapshot, buffer, sizeof(snapshot));
+	return ToMotion(motion)->LoadSnapshot(snapshot) ? 1 : 0;
+}
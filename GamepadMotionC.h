@@ -0,0 +1,144 @@
+/* Copyright (c) 2020-2021 Julian "Jibb" Smart
+ * Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info */
+
+#ifndef GAMEPADMOTION_C_H
+#define GAMEPADMOTION_C_H
+
+/* A C API around GamepadMotion, for calling from other languages. Each controller is an opaque handle, and data goes
+ * in and out through flat arrays and plain structs that you provide, so a whole frame's worth of samples and outputs
+ * for many controllers can cross the language boundary in a couple of calls instead of one call per value. Build the
+ * GamepadMotionHelpers_c shared library from GamepadMotionC.cpp, or compile that file into your own library.
+ *
+ * Samples are 7 floats each: gyro x, y, z (degrees per second), accel x, y, z (g), deltaTime (seconds), exactly like
+ * GamepadMotionHelpers::MotionSample. None of these functions are thread-safe with the same handle. */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(GAMEPADMOTION_C_BUILD)
+#define GAMEPADMOTION_C_API __declspec(dllexport)
+#elif defined(GAMEPADMOTION_C_STATIC)
+#define GAMEPADMOTION_C_API
+#else
+#define GAMEPADMOTION_C_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define GAMEPADMOTION_C_API __attribute__((visibility("default")))
+#else
+#define GAMEPADMOTION_C_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct GamepadMotionOpaque* GamepadMotionHandle;
+
+/* bit flags, as with GamepadMotionHelpers::CalibrationMode */
+enum
+{
+	GAMEPADMOTION_CALIBRATION_MANUAL = 0,
+	GAMEPADMOTION_CALIBRATION_STILLNESS = 1,
+	GAMEPADMOTION_CALIBRATION_SENSOR_FUSION = 2,
+};
+
+/* for GamepadMotionCSettings.StillnessDetection, as with GamepadMotionHelpers::StillnessMode */
+enum
+{
+	GAMEPADMOTION_STILLNESS_RANGE = 0,
+	GAMEPADMOTION_STILLNESS_NOISE_FLOOR = 1,
+};
+
+/* for GamepadMotionCSettings.GyroIntegration, as with GamepadMotionHelpers::IntegrationMode */
+enum
+{
+	GAMEPADMOTION_INTEGRATION_FIRST_ORDER = 0,
+	GAMEPADMOTION_INTEGRATION_SECOND_ORDER = 1,
+};
+
+/* the same fields in the same order as GamepadMotionSettings. GamepadMotion_GetDefaultSettings fills in the defaults */
+typedef struct GamepadMotionCSettings
+{
+	int32_t MinStillnessSamples;
+	float MinStillnessTime;
+	float MaxStillnessError;
+	float StillnessSampleDeteriorationRate;
+	float StillnessErrorClimbRate;
+	float StillnessErrorDropOnRecalibrate;
+	float StillnessCalibrationEaseInTime;
+	float StillnessCalibrationHalfTime;
+	float StillnessWindowTime;
+	int32_t StillnessDetection;
+
+	float SensorFusionCalibrationSmoothingStrength;
+	float SensorFusionAngularAccelerationThreshold;
+	float SensorFusionCalibrationEaseInTime;
+	float SensorFusionCalibrationHalfTime;
+
+	float SteadyGravityThreshold;
+	float GravityCorrectEaseInTime;
+	float GravityCorrectHalfTime;
+	float GravityCorrectMinAngle;
+
+	float MagnetometerCorrectHalfTime;
+
+	int32_t GyroIntegration;
+	int32_t OrientationNormalizeInterval;
+} GamepadMotionCSettings;
+
+/* everything you'd otherwise read with a getter each, for one controller */
+typedef struct GamepadMotionCOutputs
+{
+	float CalibratedGyro[3];
+	float Gravity[3];
+	float ProcessedAcceleration[3];
+	float Orientation[4]; /* w, x, y, z */
+	float CalibrationOffset[3];
+	int32_t CalibrationMode;
+	int32_t IsStill;
+	int32_t IsGravitySteady;
+	int32_t Changes; /* GamepadMotionHelpers::MotionChanges since the last GamepadMotion_GetOutputs */
+} GamepadMotionCOutputs;
+
+/* returns NULL if out of memory */
+GAMEPADMOTION_C_API GamepadMotionHandle GamepadMotion_Create(void);
+GAMEPADMOTION_C_API void GamepadMotion_Destroy(GamepadMotionHandle motion);
+GAMEPADMOTION_C_API void GamepadMotion_Reset(GamepadMotionHandle motion);
+
+GAMEPADMOTION_C_API void GamepadMotion_GetDefaultSettings(GamepadMotionCSettings* outSettings);
+GAMEPADMOTION_C_API void GamepadMotion_GetSettings(GamepadMotionHandle motion, GamepadMotionCSettings* outSettings);
+GAMEPADMOTION_C_API void GamepadMotion_SetSettings(GamepadMotionHandle motion, const GamepadMotionCSettings* settings);
+
+GAMEPADMOTION_C_API void GamepadMotion_SetCalibrationMode(GamepadMotionHandle motion, int32_t calibrationMode);
+GAMEPADMOTION_C_API void GamepadMotion_StartContinuousCalibration(GamepadMotionHandle motion);
+GAMEPADMOTION_C_API void GamepadMotion_PauseContinuousCalibration(GamepadMotionHandle motion);
+GAMEPADMOTION_C_API void GamepadMotion_ResetContinuousCalibration(GamepadMotionHandle motion);
+GAMEPADMOTION_C_API void GamepadMotion_SetCalibrationOffset(GamepadMotionHandle motion, float xOffset, float yOffset, float zOffset, int32_t weight);
+GAMEPADMOTION_C_API void GamepadMotion_SetTemperature(GamepadMotionHandle motion, float temperature);
+
+/* numSamples samples for one controller. If given, outCalibratedGyro receives 3 floats per sample and outOrientation
+ * receives 4 floats (w, x, y, z) per sample */
+GAMEPADMOTION_C_API void GamepadMotion_ProcessMotion(GamepadMotionHandle motion, const float* samples, int32_t numSamples,
+	float* outCalibratedGyro, float* outOrientation);
+
+/* samples for numMotions controllers back to back: numSamples[0] samples for motions[0], then numSamples[1] for
+ * motions[1], and so on. A NULL handle's samples are skipped */
+GAMEPADMOTION_C_API void GamepadMotion_ProcessMotionMany(const GamepadMotionHandle* motions, int32_t numMotions,
+	const float* samples, const int32_t* numSamples);
+
+/* fills outOutputs[i] for each of numMotions controllers, and clears the changes each one reports. A NULL handle's
+ * outputs are all zeros */
+GAMEPADMOTION_C_API void GamepadMotion_GetOutputs(const GamepadMotionHandle* motions, int32_t numMotions, GamepadMotionCOutputs* outOutputs);
+
+/* snapshots as opaque bytes, for saving with whatever your language uses. Save writes GamepadMotion_GetSnapshotSize()
+ * bytes. Load returns 0 and changes nothing if the bytes are from a different version or size, or are corrupt in a
+ * way that would be unsafe to load */
+GAMEPADMOTION_C_API int32_t GamepadMotion_GetSnapshotSize(void);
+GAMEPADMOTION_C_API void GamepadMotion_SaveSnapshot(GamepadMotionHandle motion, void* outBuffer);
+GAMEPADMOTION_C_API int32_t GamepadMotion_LoadSnapshot(GamepadMotionHandle motion, const void* buffer, int32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GAMEPADMOTION_C_H */
@@ -0,0 +1,193 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+#pragma once
+
+// Reading motion straight out of HID input reports. Give a GamepadMotionHidReader each input report as it comes in,
+// on whatever thread or event loop receives them, and it picks out the gyro and accelerometer samples, converts them to
+// GamepadMotionHelpers' units and coordinate space, and processes them there and then. There's no queue to copy into
+// and no thread to hand off to. Outputs for each sample can be written to arrays you provide, or read from the
+// GamepadMotion afterwards.
+
+#include "GamepadMotion.hpp"
+#include <stdint.h>
+
+enum class GamepadMotionHidLayout
+{
+	// report 0x01 over USB, or 0x11 over Bluetooth. One sample per report, with a 16-bit timestamp in 16/3 microsecond units
+	DualShock4,
+	// report 0x01 over USB, or 0x31 over Bluetooth. One sample per report, with a 32-bit timestamp in 1/3 microsecond units
+	DualSense,
+	// standard full report 0x30 over USB or Bluetooth. Three samples per report, 5 milliseconds apart
+	SwitchPro,
+};
+
+class GamepadMotionHidReader
+{
+public:
+	static constexpr int MaxSamplesPerReport = 3;
+
+	// sets motion's raw sensor scale and timestamp format for PlayStation controllers, so don't change them while using this
+	GamepadMotionHidReader(GamepadMotion& motion, GamepadMotionHidLayout layout);
+
+	// report is a whole input report, starting with its report ID. Returns how many samples were processed: 0 for
+	// reports without motion data, or that repeat the last report's timestamp, or for the first timestamped report,
+	// which only sets the time to measure from. If given, outCalibratedGyro receives 3 floats (x, y, z) and
+	// outOrientation 4 floats (w, x, y, z) per sample processed, up to MaxSamplesPerReport
+	int ProcessReport(const void* report, int numBytes, float* outCalibratedGyro = nullptr, float* outOrientation = nullptr);
+
+	GamepadMotion& GetMotion();
+	GamepadMotionHidLayout GetLayout() const;
+
+private:
+	GamepadMotion& Motion;
+	GamepadMotionHidLayout Layout;
+
+	// Switch Pro Controller units, and how far apart its samples are
+	static constexpr float SwitchProGyroScale = 1.f / 14.2842f;
+	static constexpr float SwitchProAccelScale = 1.f / 4096.f;
+	static constexpr float SwitchProSampleTime = 0.005f;
+
+	int ProcessPlayStationReport(const uint8_t* motionData, uint64_t timestamp, float* outCalibratedGyro, float* outOrientation);
+	int ProcessSwitchProReport(const uint8_t* imuData, float* outCalibratedGyro, float* outOrientation);
+
+	static int16_t ReadInt16(const uint8_t* bytes);
+	static uint16_t ReadUint16(const uint8_t* bytes);
+	static uint32_t ReadUint32(const uint8_t* bytes);
+};
+
+///////////// Everything below here are just implementation details /////////////
+
+inline GamepadMotionHidReader::GamepadMotionHidReader(GamepadMotion& motion, GamepadMotionHidLayout layout)
+	: Motion(motion), Layout(layout)
+{
+	switch (layout)
+	{
+	case GamepadMotionHidLayout::DualShock4:
+		Motion.SetRawSensorScale(1.f / 16.f, 1.f / 8192.f);
+		Motion.SetTimestampFormat(3000000.0 / 16.0, 16);
+		break;
+	case GamepadMotionHidLayout::DualSense:
+		Motion.SetRawSensorScale(1.f / 16.f, 1.f / 8192.f);
+		Motion.SetTimestampFormat(3000000.0, 32);
+		break;
+	case GamepadMotionHidLayout::SwitchPro:
+		// converted in ProcessSwitchProReport instead, since its axes need reordering too
+		break;
+	}
+}
+
+inline int GamepadMotionHidReader::ProcessReport(const void* report, int numBytes, float* outCalibratedGyro, float* outOrientation)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(report);
+	if (bytes == nullptr || numBytes < 1)
+	{
+		return 0;
+	}
+
+	// the report ID tells USB and Bluetooth reports apart. Bluetooth reports have extra bytes at the start, but how many
+	// depends on the controller
+	switch (Layout)
+	{
+	case GamepadMotionHidLayout::DualShock4:
+		// USB report 0x01 has its timestamp at byte 10 and motion at byte 13. Bluetooth report 0x11 has 2 more bytes
+		// first, so they're at 12 and 15
+		if (bytes[0] == 0x01 && numBytes >= 25)
+		{
+			return ProcessPlayStationReport(bytes + 13, ReadUint16(bytes + 10), outCalibratedGyro, outOrientation);
+		}
+		if (bytes[0] == 0x11 && numBytes >= 27)
+		{
+			return ProcessPlayStationReport(bytes + 15, ReadUint16(bytes + 12), outCalibratedGyro, outOrientation);
+		}
+		return 0;
+	case GamepadMotionHidLayout::DualSense:
+		// USB report 0x01 has its motion at byte 16 and timestamp at byte 28. Bluetooth report 0x31 has just 1 more byte
+		// first, so they're at 17 and 29
+		if (bytes[0] == 0x01 && numBytes >= 32)
+		{
+			return ProcessPlayStationReport(bytes + 16, ReadUint32(bytes + 28), outCalibratedGyro, outOrientation);
+		}
+		if (bytes[0] == 0x31 && numBytes >= 33)
+		{
+			return ProcessPlayStationReport(bytes + 17, ReadUint32(bytes + 29), outCalibratedGyro, outOrientation);
+		}
+		return 0;
+	case GamepadMotionHidLayout::SwitchPro:
+		// report 0x30 is the same over USB and Bluetooth, with its three samples from byte 13
+		if (bytes[0] == 0x30 && numBytes >= 49)
+		{
+			return ProcessSwitchProReport(bytes + 13, outCalibratedGyro, outOrientation);
+		}
+		return 0;
+	}
+	return 0;
+}
+
+inline GamepadMotion& GamepadMotionHidReader::GetMotion()
+{
+	return Motion;
+}
+
+inline GamepadMotionHidLayout GamepadMotionHidReader::GetLayout() const
+{
+	return Layout;
+}
+
+inline int GamepadMotionHidReader::ProcessPlayStationReport(const uint8_t* motionData, uint64_t timestamp, float* outCalibratedGyro, float* outOrientation)
+{
+	// PlayStation controllers already use the same coordinate space as GamepadMotionHelpers
+	if (!Motion.ProcessMotionRawTimestamped(ReadInt16(motionData), ReadInt16(motionData + 2), ReadInt16(motionData + 4),
+		ReadInt16(motionData + 6), ReadInt16(motionData + 8), ReadInt16(motionData + 10), timestamp))
+	{
+		return 0;
+	}
+
+	if (outCalibratedGyro != nullptr)
+	{
+		Motion.GetCalibratedGyro(outCalibratedGyro[0], outCalibratedGyro[1], outCalibratedGyro[2]);
+	}
+	if (outOrientation != nullptr)
+	{
+		Motion.GetOrientation(outOrientation[0], outOrientation[1], outOrientation[2], outOrientation[3]);
+	}
+	return 1;
+}
+
+inline int GamepadMotionHidReader::ProcessSwitchProReport(const uint8_t* imuData, float* outCalibratedGyro, float* outOrientation)
+{
+	// each sample is accel xyz then gyro xyz. The Switch Pro Controller's x points away from the player, y to the left
+	// and z up, so x becomes -z, y becomes -x and z becomes y
+	float gyro[MaxSamplesPerReport * 3];
+	float accel[MaxSamplesPerReport * 3];
+	float deltaTimes[MaxSamplesPerReport];
+	for (int sample = 0; sample < MaxSamplesPerReport; sample++)
+	{
+		const uint8_t* sampleData = imuData + sample * 12;
+		accel[sample * 3 + 0] = -ReadInt16(sampleData + 2) * SwitchProAccelScale;
+		accel[sample * 3 + 1] = ReadInt16(sampleData + 4) * SwitchProAccelScale;
+		accel[sample * 3 + 2] = -ReadInt16(sampleData + 0) * SwitchProAccelScale;
+		gyro[sample * 3 + 0] = -ReadInt16(sampleData + 8) * SwitchProGyroScale;
+		gyro[sample * 3 + 1] = ReadInt16(sampleData + 10) * SwitchProGyroScale;
+		gyro[sample * 3 + 2] = -ReadInt16(sampleData + 6) * SwitchProGyroScale;
+		deltaTimes[sample] = SwitchProSampleTime;
+	}
+
+	Motion.ProcessMotionBatch(gyro, accel, deltaTimes, MaxSamplesPerReport, outCalibratedGyro, outOrientation);
+	return MaxSamplesPerReport;
+}
+
+inline int16_t GamepadMotionHidReader::ReadInt16(const uint8_t* bytes)
+{
+	return (int16_t)ReadUint16(bytes);
+}
+
+inline uint16_t GamepadMotionHidReader::ReadUint16(const uint8_t* bytes)
+{
+	return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+inline uint32_t GamepadMotionHidReader::ReadUint32(const uint8_t* bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
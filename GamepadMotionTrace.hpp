@@ -0,0 +1,532 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+#pragma once
+
+// Recording and replaying IMU traces. A trace is a 64 byte header followed by fixed-size records, either as floats
+// (exactly the layout of GamepadMotionHelpers::MotionSample) or quantized to int16 like most controllers report them.
+// All values are little-endian. Traces are read by memory-mapping the file, so replaying doesn't copy the whole file.
+
+#include "GamepadMotion.hpp"
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum class GamepadMotionTraceEncoding : uint16_t
+{
+	// 7 floats per sample: gyro xyz (degrees per second), accel xyz (g), deltaTime (seconds)
+	Float32 = 0,
+	// 6 int16 counts for gyro xyz and accel xyz, then a uint16 deltaTime count. Multiply by the header's scales to get units
+	Int16 = 1,
+};
+
+struct GamepadMotionTraceHeader
+{
+	char Magic[4];
+	uint16_t Version;
+	GamepadMotionTraceEncoding Encoding;
+	float SampleRate; // nominal reports per second, for information only
+	float GyroScale; // degrees per second per count, Int16 only
+	float AccelScale; // g per count, Int16 only
+	float DeltaTimeScale; // seconds per count, Int16 only
+	uint32_t NumSamples;
+	uint16_t VendorId;
+	uint16_t ProductId;
+	char DeviceName[32];
+
+	GamepadMotionTraceHeader();
+	int GetRecordSize() const;
+};
+
+static_assert(sizeof(GamepadMotionTraceHeader) == 64, "GamepadMotionTraceHeader must be 64 bytes");
+static_assert(sizeof(GamepadMotionHelpers::MotionSample) == 28, "MotionSample must be 7 floats");
+
+class GamepadMotionTraceWriter
+{
+public:
+	GamepadMotionTraceWriter();
+	~GamepadMotionTraceWriter();
+
+	// header.NumSamples is ignored and filled in by Close()
+	bool Open(const char* path, const GamepadMotionTraceHeader& header);
+	void Close();
+	bool IsOpen() const;
+
+	// with Int16 encoding, samples are quantized using the header's scales
+	bool WriteSample(const GamepadMotionHelpers::MotionSample& sample);
+	bool WriteSamples(const GamepadMotionHelpers::MotionSample* samples, int numSamples);
+	// write counts exactly as the controller reported them. Only valid with Int16 encoding
+	bool WriteRawSample(const int16_t gyro[3], const int16_t accel[3], float deltaTime);
+
+private:
+	FILE* File;
+	GamepadMotionTraceHeader Header;
+	uint32_t NumSamples;
+
+	bool WriteRecord(const void* record);
+};
+
+class GamepadMotionTraceReader
+{
+public:
+	GamepadMotionTraceReader();
+	~GamepadMotionTraceReader();
+
+	// map a trace file. Returns false if it can't be opened or isn't a valid trace
+	bool Open(const char* path);
+	// read a trace that's already in memory. The memory must stay valid until Close(), and should be 4-byte aligned
+	// for GetFloatSamples to work
+	bool OpenMemory(const void* data, size_t size);
+	void Close();
+	bool IsOpen() const;
+
+	const GamepadMotionTraceHeader& GetHeader() const;
+	int GetNumSamples() const;
+	int GetPosition() const;
+	void Seek(int sample);
+
+	// decode up to maxSamples from the current position, returning how many were read
+	int Read(GamepadMotionHelpers::MotionSample* outSamples, int maxSamples);
+	// with Float32 encoding, the mapped samples can be used directly without decoding. Otherwise returns nullptr
+	const GamepadMotionHelpers::MotionSample* GetFloatSamples() const;
+
+	// feed up to maxSamples from the current position into motion with ProcessMotionBatch. Returns how many were processed
+	int Replay(GamepadMotion& motion, int maxSamples = 0x7fffffff);
+
+private:
+	const unsigned char* Data;
+	size_t Size;
+	GamepadMotionTraceHeader Header;
+	int NumSamples;
+	int Position;
+#if defined(_WIN32)
+	HANDLE FileHandle;
+	HANDLE MappingHandle;
+#else
+	int FileDescriptor;
+#endif
+	bool IsMapped;
+
+	bool ReadHeader();
+};
+
+///////////// Everything below here are just implementation details /////////////
+
+namespace GamepadMotionHelpers
+{
+	inline int16_t QuantizeTraceValue(float value, float scale)
+	{
+		const float counts = scale > 0.f ? value / scale : 0.f;
+		const float rounded = counts < 0.f ? counts - 0.5f : counts + 0.5f;
+		return (int16_t)std::clamp(rounded, -32768.f, 32767.f);
+	}
+
+	inline uint16_t QuantizeTraceDeltaTime(float deltaTime, float scale)
+	{
+		const float counts = scale > 0.f ? deltaTime / scale + 0.5f : 0.f;
+		return (uint16_t)std::clamp(counts, 0.f, 65535.f);
+	}
+
+	struct TraceInt16Record
+	{
+		int16_t Gyro[3];
+		int16_t Accel[3];
+		uint16_t DeltaTime;
+	};
+
+	static_assert(sizeof(TraceInt16Record) == 14, "TraceInt16Record must be 14 bytes");
+} // namespace GamepadMotionHelpers
+
+inline GamepadMotionTraceHeader::GamepadMotionTraceHeader()
+{
+	memcpy(Magic, "GMHT", 4);
+	Version = 1;
+	Encoding = GamepadMotionTraceEncoding::Float32;
+	SampleRate = 0.f;
+	GyroScale = 1.f;
+	AccelScale = 1.f;
+	DeltaTimeScale = 1e-6f;
+	NumSamples = 0;
+	VendorId = 0;
+	ProductId = 0;
+	memset(DeviceName, 0, sizeof(DeviceName));
+}
+
+inline int GamepadMotionTraceHeader::GetRecordSize() const
+{
+	return Encoding == GamepadMotionTraceEncoding::Int16 ? (int)sizeof(GamepadMotionHelpers::TraceInt16Record) : (int)sizeof(GamepadMotionHelpers::MotionSample);
+}
+
+inline GamepadMotionTraceWriter::GamepadMotionTraceWriter()
+{
+	File = nullptr;
+	NumSamples = 0;
+}
+
+inline GamepadMotionTraceWriter::~GamepadMotionTraceWriter()
+{
+	Close();
+}
+
+inline bool GamepadMotionTraceWriter::Open(const char* path, const GamepadMotionTraceHeader& header)
+{
+	Close();
+	File = fopen(path, "wb");
+	if (File == nullptr)
+	{
+		return false;
+	}
+
+	Header = header;
+	memcpy(Header.Magic, "GMHT", 4);
+	Header.Version = 1;
+	Header.NumSamples = 0;
+	NumSamples = 0;
+	if (fwrite(&Header, sizeof(Header), 1, File) != 1)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+inline void GamepadMotionTraceWriter::Close()
+{
+	if (File == nullptr)
+	{
+		return;
+	}
+
+	// go back and fill in the sample count now that we know it
+	Header.NumSamples = NumSamples;
+	if (fseek(File, 0, SEEK_SET) == 0)
+	{
+		fwrite(&Header, sizeof(Header), 1, File);
+	}
+	fclose(File);
+	File = nullptr;
+}
+
+inline bool GamepadMotionTraceWriter::IsOpen() const
+{
+	return File != nullptr;
+}
+
+inline bool GamepadMotionTraceWriter::WriteSample(const GamepadMotionHelpers::MotionSample& sample)
+{
+	if (Header.Encoding == GamepadMotionTraceEncoding::Int16)
+	{
+		GamepadMotionHelpers::TraceInt16Record record;
+		record.Gyro[0] = GamepadMotionHelpers::QuantizeTraceValue(sample.GyroX, Header.GyroScale);
+		record.Gyro[1] = GamepadMotionHelpers::QuantizeTraceValue(sample.GyroY, Header.GyroScale);
+		record.Gyro[2] = GamepadMotionHelpers::QuantizeTraceValue(sample.GyroZ, Header.GyroScale);
+		record.Accel[0] = GamepadMotionHelpers::QuantizeTraceValue(sample.AccelX, Header.AccelScale);
+		record.Accel[1] = GamepadMotionHelpers::QuantizeTraceValue(sample.AccelY, Header.AccelScale);
+		record.Accel[2] = GamepadMotionHelpers::QuantizeTraceValue(sample.AccelZ, Header.AccelScale);
+		record.DeltaTime = GamepadMotionHelpers::QuantizeTraceDeltaTime(sample.DeltaTime, Header.DeltaTimeScale);
+		return WriteRecord(&record);
+	}
+
+	return WriteRecord(&sample);
+}
+
+inline bool GamepadMotionTraceWriter::WriteSamples(const GamepadMotionHelpers::MotionSample* samples, int numSamples)
+{
+	if (File == nullptr)
+	{
+		return false;
+	}
+
+	if (Header.Encoding == GamepadMotionTraceEncoding::Float32)
+	{
+		const size_t written = fwrite(samples, sizeof(GamepadMotionHelpers::MotionSample), (size_t)numSamples, File);
+		NumSamples += (uint32_t)written;
+		return written == (size_t)numSamples;
+	}
+
+	for (int i = 0; i < numSamples; i++)
+	{
+		if (!WriteSample(samples[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool GamepadMotionTraceWriter::WriteRawSample(const int16_t gyro[3], const int16_t accel[3], float deltaTime)
+{
+	if (Header.Encoding != GamepadMotionTraceEncoding::Int16)
+	{
+		return false;
+	}
+
+	GamepadMotionHelpers::TraceInt16Record record;
+	memcpy(record.Gyro, gyro, sizeof(record.Gyro));
+	memcpy(record.Accel, accel, sizeof(record.Accel));
+	record.DeltaTime = GamepadMotionHelpers::QuantizeTraceDeltaTime(deltaTime, Header.DeltaTimeScale);
+	return WriteRecord(&record);
+}
+
+inline bool GamepadMotionTraceWriter::WriteRecord(const void* record)
+{
+	if (File == nullptr || fwrite(record, (size_t)Header.GetRecordSize(), 1, File) != 1)
+	{
+		return false;
+	}
+	NumSamples++;
+	return true;
+}
+
+inline GamepadMotionTraceReader::GamepadMotionTraceReader()
+{
+	Data = nullptr;
+	Size = 0;
+	NumSamples = 0;
+	Position = 0;
+#if defined(_WIN32)
+	FileHandle = INVALID_HANDLE_VALUE;
+	MappingHandle = nullptr;
+#else
+	FileDescriptor = -1;
+#endif
+	IsMapped = false;
+}
+
+inline GamepadMotionTraceReader::~GamepadMotionTraceReader()
+{
+	Close();
+}
+
+inline bool GamepadMotionTraceReader::Open(const char* path)
+{
+	Close();
+#if defined(_WIN32)
+	FileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(FileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(GamepadMotionTraceHeader))
+	{
+		Close();
+		return false;
+	}
+	MappingHandle = CreateFileMappingA(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (MappingHandle == nullptr)
+	{
+		Close();
+		return false;
+	}
+	Data = (const unsigned char*)MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+	Size = (size_t)fileSize.QuadPart;
+#else
+	FileDescriptor = open(path, O_RDONLY);
+	if (FileDescriptor < 0)
+	{
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(FileDescriptor, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(GamepadMotionTraceHeader))
+	{
+		Close();
+		return false;
+	}
+	void* mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	madvise(mapped, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+	Data = (const unsigned char*)mapped;
+	Size = (size_t)fileStat.st_size;
+#endif
+	IsMapped = true;
+	if (Data == nullptr || !ReadHeader())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+inline bool GamepadMotionTraceReader::OpenMemory(const void* data, size_t size)
+{
+	Close();
+	Data = (const unsigned char*)data;
+	Size = size;
+	if (Data == nullptr || !ReadHeader())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+inline void GamepadMotionTraceReader::Close()
+{
+	if (IsMapped)
+	{
+#if defined(_WIN32)
+		if (Data != nullptr)
+		{
+			UnmapViewOfFile(Data);
+		}
+		if (MappingHandle != nullptr)
+		{
+			CloseHandle(MappingHandle);
+		}
+#else
+		if (Data != nullptr)
+		{
+			munmap((void*)Data, Size);
+		}
+#endif
+	}
+#if defined(_WIN32)
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FileHandle);
+	}
+	FileHandle = INVALID_HANDLE_VALUE;
+	MappingHandle = nullptr;
+#else
+	if (FileDescriptor >= 0)
+	{
+		close(FileDescriptor);
+	}
+	FileDescriptor = -1;
+#endif
+	IsMapped = false;
+	Data = nullptr;
+	Size = 0;
+	NumSamples = 0;
+	Position = 0;
+}
+
+inline bool GamepadMotionTraceReader::IsOpen() const
+{
+	return Data != nullptr;
+}
+
+inline const GamepadMotionTraceHeader& GamepadMotionTraceReader::GetHeader() const
+{
+	return Header;
+}
+
+inline int GamepadMotionTraceReader::GetNumSamples() const
+{
+	return NumSamples;
+}
+
+inline int GamepadMotionTraceReader::GetPosition() const
+{
+	return Position;
+}
+
+inline void GamepadMotionTraceReader::Seek(int sample)
+{
+	Position = std::clamp(sample, 0, NumSamples);
+}
+
+inline int GamepadMotionTraceReader::Read(GamepadMotionHelpers::MotionSample* outSamples, int maxSamples)
+{
+	const int count = std::max(0, std::min(maxSamples, NumSamples - Position));
+	const unsigned char* records = Data + sizeof(GamepadMotionTraceHeader);
+	if (Header.Encoding == GamepadMotionTraceEncoding::Float32)
+	{
+		memcpy(outSamples, records + (size_t)Position * sizeof(GamepadMotionHelpers::MotionSample), (size_t)count * sizeof(GamepadMotionHelpers::MotionSample));
+	}
+	else
+	{
+		const float gyroScale = Header.GyroScale;
+		const float accelScale = Header.AccelScale;
+		const float deltaTimeScale = Header.DeltaTimeScale;
+		const unsigned char* record = records + (size_t)Position * sizeof(GamepadMotionHelpers::TraceInt16Record);
+		for (int i = 0; i < count; i++, record += sizeof(GamepadMotionHelpers::TraceInt16Record))
+		{
+			GamepadMotionHelpers::TraceInt16Record decoded;
+			memcpy(&decoded, record, sizeof(decoded));
+			GamepadMotionHelpers::MotionSample& sample = outSamples[i];
+			sample.GyroX = decoded.Gyro[0] * gyroScale;
+			sample.GyroY = decoded.Gyro[1] * gyroScale;
+			sample.GyroZ = decoded.Gyro[2] * gyroScale;
+			sample.AccelX = decoded.Accel[0] * accelScale;
+			sample.AccelY = decoded.Accel[1] * accelScale;
+			sample.AccelZ = decoded.Accel[2] * accelScale;
+			sample.DeltaTime = decoded.DeltaTime * deltaTimeScale;
+		}
+	}
+	Position += count;
+	return count;
+}
+
+inline const GamepadMotionHelpers::MotionSample* GamepadMotionTraceReader::GetFloatSamples() const
+{
+	if (Data == nullptr || Header.Encoding != GamepadMotionTraceEncoding::Float32 || ((uintptr_t)Data % alignof(float)) != 0)
+	{
+		return nullptr;
+	}
+	return (const GamepadMotionHelpers::MotionSample*)(Data + sizeof(GamepadMotionTraceHeader));
+}
+
+inline int GamepadMotionTraceReader::Replay(GamepadMotion& motion, int maxSamples)
+{
+	const int count = std::max(0, std::min(maxSamples, NumSamples - Position));
+	const GamepadMotionHelpers::MotionSample* floatSamples = GetFloatSamples();
+	if (floatSamples != nullptr)
+	{
+		// no decoding needed, so process straight from the mapped file
+		motion.ProcessMotionBatch(floatSamples + Position, count);
+		Position += count;
+		return count;
+	}
+
+	GamepadMotionHelpers::MotionSample decoded[256];
+	int remaining = count;
+	while (remaining > 0)
+	{
+		const int chunk = Read(decoded, std::min(remaining, 256));
+		motion.ProcessMotionBatch(decoded, chunk);
+		remaining -= chunk;
+	}
+	return count;
+}
+
+inline bool GamepadMotionTraceReader::ReadHeader()
+{
+	if (Size < sizeof(GamepadMotionTraceHeader))
+	{
+		return false;
+	}
+
+	memcpy(&Header, Data, sizeof(Header));
+	if (memcmp(Header.Magic, "GMHT", 4) != 0 || Header.Version != 1 ||
+		(Header.Encoding != GamepadMotionTraceEncoding::Float32 && Header.Encoding != GamepadMotionTraceEncoding::Int16))
+	{
+		return false;
+	}
+
+	// trust the file size over the header, in case recording was cut short before the writer was closed
+	const size_t recordsInFile = (Size - sizeof(GamepadMotionTraceHeader)) / (size_t)Header.GetRecordSize();
+	const size_t numSamples = Header.NumSamples == 0 ? recordsInFile : std::min((size_t)Header.NumSamples, recordsInFile);
+	NumSamples = (int)std::min(numSamples, (size_t)0x7fffffff);
+	Position = 0;
+	return true;
+}
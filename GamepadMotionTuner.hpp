@@ -0,0 +1,280 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+#pragma once
+
+// Offline tuning of GamepadMotionSettings. Give a GamepadMotionTuner some recorded traces along with the gyro bias
+// calibration should find in each, and some candidate settings. It runs every candidate on every trace, each with its
+// own GamepadMotion, spread across as many threads as you like, and scores how closely and how quickly each candidate
+// calibrates.
+
+#include "GamepadMotion.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// how one candidate did on one trace
+struct GamepadMotionTunerResult
+{
+	float MeanError; // average distance from the calibration offset to the true bias over the trace, in degrees per second
+	float FinalError; // the same at the end of the trace
+	float TimeToCalibrate; // seconds until the error stays within the calibrated threshold for the rest of the trace. -1 if it never does
+};
+
+// how one candidate did over every trace
+struct GamepadMotionTunerScore
+{
+	float MeanError; // the average of each trace's MeanError. Lower is better, and it's what GetBestCandidate goes by
+	float WorstFinalError;
+	float MeanTimeToCalibrate; // traces that never calibrate count their whole length
+	int NumNeverCalibrated;
+};
+
+class GamepadMotionTuner
+{
+public:
+	GamepadMotionTuner();
+
+	// samples must stay valid until the tuner is done with them. Returns the trace's index
+	int AddTrace(const GamepadMotionHelpers::MotionSample* samples, int numSamples, float trueBiasX, float trueBiasY, float trueBiasZ);
+	// returns the candidate's index
+	int AddCandidate(const GamepadMotionSettings& settings);
+	void ClearCandidates();
+
+	// defaults to Stillness | SensorFusion
+	void SetCalibrationMode(GamepadMotionHelpers::CalibrationMode calibrationMode);
+	// how close to the true bias counts as calibrated, for TimeToCalibrate. Defaults to 0.5 degrees per second
+	void SetCalibratedThreshold(float degreesPerSecond);
+
+	// run every candidate on every trace. Each pair is independent, and threads take the next one as soon as they're
+	// free. numThreads <= 0 uses every hardware thread
+	void Run(int numThreads = 0);
+
+	int GetNumTraces() const;
+	int GetNumCandidates() const;
+	const GamepadMotionSettings& GetCandidate(int candidate) const;
+	// only valid after Run
+	const GamepadMotionTunerResult& GetResult(int candidate, int trace) const;
+	GamepadMotionTunerScore GetScore(int candidate) const;
+	int GetBestCandidate() const;
+
+private:
+	struct Trace
+	{
+		const GamepadMotionHelpers::MotionSample* Samples;
+		int NumSamples;
+		GamepadMotionHelpers::Vec TrueBias;
+		float Duration;
+	};
+
+	// how many samples to process between checking the calibration offset
+	static constexpr int EvaluationInterval = 32;
+
+	std::vector<Trace> Traces;
+	std::vector<GamepadMotionSettings> Candidates;
+	std::vector<GamepadMotionTunerResult> Results;
+	GamepadMotionHelpers::CalibrationMode CalibrationMode;
+	float CalibratedThreshold;
+
+	GamepadMotionTunerResult RunPair(int candidate, int trace) const;
+};
+
+///////////// Everything below here are just implementation details /////////////
+
+inline GamepadMotionTuner::GamepadMotionTuner()
+{
+	CalibrationMode = GamepadMotionHelpers::CalibrationMode::Stillness | GamepadMotionHelpers::CalibrationMode::SensorFusion;
+	CalibratedThreshold = 0.5f;
+}
+
+inline int GamepadMotionTuner::AddTrace(const GamepadMotionHelpers::MotionSample* samples, int numSamples, float trueBiasX, float trueBiasY, float trueBiasZ)
+{
+	Trace trace;
+	trace.Samples = samples;
+	trace.NumSamples = samples != nullptr ? std::max(0, numSamples) : 0;
+	trace.TrueBias = GamepadMotionHelpers::Vec(trueBiasX, trueBiasY, trueBiasZ);
+	trace.Duration = 0.f;
+	for (int sample = 0; sample < trace.NumSamples; sample++)
+	{
+		trace.Duration += samples[sample].DeltaTime;
+	}
+	Traces.push_back(trace);
+	Results.clear();
+	return (int)Traces.size() - 1;
+}
+
+inline int GamepadMotionTuner::AddCandidate(const GamepadMotionSettings& settings)
+{
+	Candidates.push_back(settings);
+	Results.clear();
+	return (int)Candidates.size() - 1;
+}
+
+inline void GamepadMotionTuner::ClearCandidates()
+{
+	Candidates.clear();
+	Results.clear();
+}
+
+inline void GamepadMotionTuner::SetCalibrationMode(GamepadMotionHelpers::CalibrationMode calibrationMode)
+{
+	CalibrationMode = calibrationMode;
+}
+
+inline void GamepadMotionTuner::SetCalibratedThreshold(float degreesPerSecond)
+{
+	CalibratedThreshold = degreesPerSecond;
+}
+
+inline void GamepadMotionTuner::Run(int numThreads)
+{
+	const int numTraces = (int)Traces.size();
+	const int numPairs = numTraces * (int)Candidates.size();
+	Results.assign(numPairs, GamepadMotionTunerResult());
+	if (numPairs == 0)
+	{
+		return;
+	}
+
+	// longest traces first, so that the last pairs to be picked up are short ones and threads finish close together
+	std::vector<int> traceOrder(numTraces);
+	for (int trace = 0; trace < numTraces; trace++)
+	{
+		traceOrder[trace] = trace;
+	}
+	std::sort(traceOrder.begin(), traceOrder.end(), [this](int a, int b) { return Traces[a].NumSamples > Traces[b].NumSamples; });
+
+	std::atomic<int> nextPair(0);
+	auto worker = [this, &nextPair, &traceOrder, numTraces]()
+	{
+		for (int pair = nextPair.fetch_add(1, std::memory_order_relaxed); pair < (int)Results.size(); pair = nextPair.fetch_add(1, std::memory_order_relaxed))
+		{
+			const int trace = traceOrder[pair / (int)Candidates.size()];
+			const int candidate = pair % (int)Candidates.size();
+			Results[candidate * numTraces + trace] = RunPair(candidate, trace);
+		}
+	};
+
+	if (numThreads <= 0)
+	{
+		numThreads = (int)std::thread::hardware_concurrency();
+	}
+	numThreads = std::max(1, std::min(numThreads, numPairs));
+
+	// this thread works too
+	std::vector<std::thread> threads;
+	for (int thread = 1; thread < numThreads; thread++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+inline int GamepadMotionTuner::GetNumTraces() const
+{
+	return (int)Traces.size();
+}
+
+inline int GamepadMotionTuner::GetNumCandidates() const
+{
+	return (int)Candidates.size();
+}
+
+inline const GamepadMotionSettings& GamepadMotionTuner::GetCandidate(int candidate) const
+{
+	return Candidates[candidate];
+}
+
+inline const GamepadMotionTunerResult& GamepadMotionTuner::GetResult(int candidate, int trace) const
+{
+	return Results[candidate * Traces.size() + trace];
+}
+
+inline GamepadMotionTunerScore GamepadMotionTuner::GetScore(int candidate) const
+{
+	GamepadMotionTunerScore score = {};
+	const int numTraces = (int)Traces.size();
+	if (numTraces == 0 || Results.empty())
+	{
+		return score;
+	}
+
+	for (int trace = 0; trace < numTraces; trace++)
+	{
+		const GamepadMotionTunerResult& result = GetResult(candidate, trace);
+		score.MeanError += result.MeanError;
+		score.WorstFinalError = std::max(score.WorstFinalError, result.FinalError);
+		if (result.TimeToCalibrate < 0.f)
+		{
+			score.MeanTimeToCalibrate += Traces[trace].Duration;
+			score.NumNeverCalibrated++;
+		}
+		else
+		{
+			score.MeanTimeToCalibrate += result.TimeToCalibrate;
+		}
+	}
+	score.MeanError /= numTraces;
+	score.MeanTimeToCalibrate /= numTraces;
+	return score;
+}
+
+inline int GamepadMotionTuner::GetBestCandidate() const
+{
+	int best = -1;
+	float bestError = 0.f;
+	for (int candidate = 0; candidate < (int)Candidates.size(); candidate++)
+	{
+		const float error = GetScore(candidate).MeanError;
+		if (best < 0 || error < bestError)
+		{
+			best = candidate;
+			bestError = error;
+		}
+	}
+	return best;
+}
+
+inline GamepadMotionTunerResult GamepadMotionTuner::RunPair(int candidate, int trace) const
+{
+	const Trace& data = Traces[trace];
+	GamepadMotion motion;
+	motion.Settings = Candidates[candidate];
+	motion.SetCalibrationMode(CalibrationMode);
+
+	double totalError = 0.0;
+	float time = 0.f;
+	float lastUncalibratedTime = 0.f;
+	float error = data.TrueBias.Length();
+	for (int first = 0; first < data.NumSamples; first += EvaluationInterval)
+	{
+		const int count = std::min(EvaluationInterval, data.NumSamples - first);
+		motion.ProcessMotionBatch(data.Samples + first, count);
+
+		float intervalTime = 0.f;
+		for (int sample = first; sample < first + count; sample++)
+		{
+			intervalTime += data.Samples[sample].DeltaTime;
+		}
+		time += intervalTime;
+
+		GamepadMotionHelpers::Vec offset;
+		motion.GetCalibrationOffset(offset.x, offset.y, offset.z);
+		error = (offset - data.TrueBias).Length();
+		totalError += (double)(error * intervalTime);
+		if (error > CalibratedThreshold)
+		{
+			lastUncalibratedTime = time;
+		}
+	}
+
+	GamepadMotionTunerResult result;
+	result.MeanError = time > 0.f ? (float)(totalError / time) : error;
+	result.FinalError = error;
+	result.TimeToCalibrate = error > CalibratedThreshold ? -1.f : lastUncalibratedTime;
+	return result;
+}
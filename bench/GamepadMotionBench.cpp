@@ -0,0 +1,837 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+// Micro-benchmark for GamepadMotionHelpers. Replays a synthetic (or recorded) IMU stream through many controllers in
+// each calibration mode and reports the cost per sample.
+//
+// Usage: GamepadMotionHelpers_bench [--samples N] [--batch N] [--controllers 1,4,16,64] [--trace file] [--digest [--expect file]] [--accuracy] [--snapshots] [--hid]
+// A trace file is either a binary trace (see GamepadMotionTrace.hpp) or plain text with one sample per line:
+// gyroX gyroY gyroZ accelX accelY accelZ deltaTime
+// --digest skips timing and prints a hash of every output after every sample in each calibration mode instead. Built
+// with GAMEPADMOTION_DETERMINISTIC, it should be the same on every platform. With --expect, it compares them against a file
+// of lines like it prints, "mode digest", and returns 1 if any differ. bench/GamepadMotionDigests.txt has the synthetic
+// stream's deterministic digests, which CTest checks in deterministic builds.
+// --accuracy skips timing and checks that gravity correction levels out a tilted controller at a few sample rates,
+// returning 1 if it doesn't. CTest runs it.
+// --snapshots skips timing and checks that LoadSnapshot rejects snapshots with a corrupted sliding window, returning 1
+// if any load. CTest runs it too.
+// --hid skips timing and checks that GamepadMotionHidReader decodes fixed DualShock 4, DualSense and Switch Pro
+// Controller reports over USB and Bluetooth with the right axes, signs and units, returning 1 if any don't. CTest runs it.
+
+#include "GamepadMotion.hpp"
+#include "GamepadMotionHid.hpp"
+#include "GamepadMotionTrace.hpp"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const int MaxBenchControllers = 64;
+
+	// counts last-level cache misses for this thread, where the OS lets us
+	class CacheMissCounter
+	{
+	public:
+		CacheMissCounter()
+		{
+#if defined(__linux__)
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			FileDescriptor = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+		}
+
+		~CacheMissCounter()
+		{
+#if defined(__linux__)
+			if (FileDescriptor >= 0)
+			{
+				close(FileDescriptor);
+			}
+#endif
+		}
+
+		bool IsAvailable() const
+		{
+			return FileDescriptor >= 0;
+		}
+
+		void Start()
+		{
+#if defined(__linux__)
+			if (FileDescriptor >= 0)
+			{
+				ioctl(FileDescriptor, PERF_EVENT_IOC_RESET, 0);
+				ioctl(FileDescriptor, PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+		}
+
+		long long Stop()
+		{
+			long long count = -1;
+#if defined(__linux__)
+			if (FileDescriptor >= 0)
+			{
+				ioctl(FileDescriptor, PERF_EVENT_IOC_DISABLE, 0);
+				if (read(FileDescriptor, &count, sizeof(count)) != sizeof(count))
+				{
+					count = -1;
+				}
+			}
+#endif
+			return count;
+		}
+
+	private:
+		int FileDescriptor = -1;
+	};
+
+	// deterministic so that runs are comparable
+	class Random
+	{
+	public:
+		float Next()
+		{
+			State = State * 1664525u + 1013904223u;
+			return ((State >> 8) / 16777216.f) * 2.f - 1.f;
+		}
+
+	private:
+		unsigned int State = 12345u;
+	};
+
+	// cycles between resting on a desk, being held, and fast aiming, at 1 kHz
+	std::vector<GamepadMotionHelpers::MotionSample> MakeSyntheticStream(int numSamples)
+	{
+		std::vector<GamepadMotionHelpers::MotionSample> samples(numSamples);
+		Random random;
+		const float deltaTime = 0.001f;
+		for (int i = 0; i < numSamples; i++)
+		{
+			const float time = i * deltaTime;
+			const int segment = (i / 3000) % 3;
+			const float motionScale = segment == 0 ? 0.f : (segment == 1 ? 5.f : 120.f);
+			GamepadMotionHelpers::MotionSample& sample = samples[i];
+			// the library's Sin and Cos, so that the stream is the same everywhere with GAMEPADMOTION_DETERMINISTIC
+			sample.GyroX = 0.8f + random.Next() * 0.15f + motionScale * GamepadMotionHelpers::Sin(time * 2.3f);
+			sample.GyroY = -0.4f + random.Next() * 0.15f + motionScale * GamepadMotionHelpers::Sin(time * 1.7f + 1.f);
+			sample.GyroZ = 0.2f + random.Next() * 0.15f + motionScale * 0.5f * GamepadMotionHelpers::Sin(time * 3.1f + 2.f);
+			const float tilt = segment == 0 ? 0.f : 0.3f * GamepadMotionHelpers::Sin(time * 0.9f);
+			sample.AccelX = GamepadMotionHelpers::Sin(tilt) + random.Next() * 0.005f + (segment == 2 ? 0.2f * random.Next() : 0.f);
+			sample.AccelY = -GamepadMotionHelpers::Cos(tilt) + random.Next() * 0.005f;
+			sample.AccelZ = random.Next() * 0.005f;
+			sample.DeltaTime = deltaTime;
+		}
+		return samples;
+	}
+
+	bool LoadStream(const char* path, std::vector<GamepadMotionHelpers::MotionSample>& samples)
+	{
+		GamepadMotionTraceReader trace;
+		if (trace.Open(path))
+		{
+			samples.resize(trace.GetNumSamples());
+			trace.Read(samples.data(), trace.GetNumSamples());
+			return !samples.empty();
+		}
+
+		FILE* file = fopen(path, "r");
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		GamepadMotionHelpers::MotionSample sample;
+		while (fscanf(file, "%f %f %f %f %f %f %f", &sample.GyroX, &sample.GyroY, &sample.GyroZ,
+			&sample.AccelX, &sample.AccelY, &sample.AccelZ, &sample.DeltaTime) == 7)
+		{
+			samples.push_back(sample);
+		}
+		fclose(file);
+		return !samples.empty();
+	}
+
+	enum class Api
+	{
+		ProcessMotion,
+		ProcessMotionBatch,
+		Pool,
+	};
+
+	const char* GetApiName(Api api)
+	{
+		switch (api)
+		{
+		case Api::ProcessMotion: return "ProcessMotion";
+		case Api::ProcessMotionBatch: return "ProcessMotionBatch";
+		case Api::Pool: return "GamepadMotionPool";
+		}
+		return "";
+	}
+
+	const char* GetModeName(GamepadMotionHelpers::CalibrationMode mode)
+	{
+		const bool stillness = (mode & GamepadMotionHelpers::CalibrationMode::Stillness) != 0;
+		const bool sensorFusion = (mode & GamepadMotionHelpers::CalibrationMode::SensorFusion) != 0;
+		if (stillness && sensorFusion)
+		{
+			return "Stillness|SensorFusion";
+		}
+		return stillness ? "Stillness" : (sensorFusion ? "SensorFusion" : "Manual");
+	}
+
+	struct RunResult
+	{
+		double Seconds;
+		long long CacheMisses;
+		float Checksum;
+	};
+
+	// each controller plays the same stream from a different starting point, so they aren't all in lockstep
+	int GetStreamOffset(int controller, int streamLength)
+	{
+		return (controller * 7919) % streamLength;
+	}
+
+	RunResult Run(Api api, GamepadMotionHelpers::CalibrationMode mode, int numControllers, int samplesPerController, int batchSize,
+		const std::vector<GamepadMotionHelpers::MotionSample>& stream, CacheMissCounter& cacheMisses)
+	{
+		const int streamLength = (int)stream.size();
+		RunResult result = {};
+		std::chrono::steady_clock::time_point start;
+
+		if (api == Api::Pool)
+		{
+			std::unique_ptr<GamepadMotionPool<MaxBenchControllers>> pool(new GamepadMotionPool<MaxBenchControllers>());
+			for (int controller = 0; controller < numControllers; controller++)
+			{
+				pool->SetCalibrationMode(controller, mode);
+			}
+
+			cacheMisses.Start();
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < samplesPerController; i++)
+			{
+				for (int controller = 0; controller < numControllers; controller++)
+				{
+					const GamepadMotionHelpers::MotionSample& sample = stream[(GetStreamOffset(controller, streamLength) + i) % streamLength];
+					pool->QueueMotion(controller, sample.GyroX, sample.GyroY, sample.GyroZ, sample.AccelX, sample.AccelY, sample.AccelZ, sample.DeltaTime);
+				}
+				pool->ProcessMotion();
+			}
+			result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			result.CacheMisses = cacheMisses.Stop();
+
+			for (int controller = 0; controller < numControllers; controller++)
+			{
+				float w, x, y, z;
+				pool->GetOrientation(controller, w, x, y, z);
+				result.Checksum += w + x + y + z;
+			}
+			return result;
+		}
+
+		std::vector<GamepadMotion> motions(numControllers);
+		for (GamepadMotion& motion : motions)
+		{
+			motion.SetCalibrationMode(mode);
+		}
+
+		cacheMisses.Start();
+		start = std::chrono::steady_clock::now();
+		if (api == Api::ProcessMotion)
+		{
+			for (int i = 0; i < samplesPerController; i++)
+			{
+				for (int controller = 0; controller < numControllers; controller++)
+				{
+					const GamepadMotionHelpers::MotionSample& sample = stream[(GetStreamOffset(controller, streamLength) + i) % streamLength];
+					motions[controller].ProcessMotion(sample.GyroX, sample.GyroY, sample.GyroZ, sample.AccelX, sample.AccelY, sample.AccelZ, sample.DeltaTime);
+				}
+			}
+		}
+		else
+		{
+			// like draining several reports per controller each poll
+			for (int i = 0; i < samplesPerController; i += batchSize)
+			{
+				const int count = std::min(batchSize, samplesPerController - i);
+				for (int controller = 0; controller < numControllers; controller++)
+				{
+					const int first = (GetStreamOffset(controller, streamLength) + i) % streamLength;
+					const int contiguous = std::min(count, streamLength - first);
+					motions[controller].ProcessMotionBatch(&stream[first], contiguous);
+					if (contiguous < count)
+					{
+						motions[controller].ProcessMotionBatch(&stream[0], count - contiguous);
+					}
+				}
+			}
+		}
+		result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.CacheMisses = cacheMisses.Stop();
+
+		for (GamepadMotion& motion : motions)
+		{
+			float w, x, y, z;
+			motion.GetOrientation(w, x, y, z);
+			result.Checksum += w + x + y + z;
+		}
+		return result;
+	}
+
+	// 64-bit FNV-1a over the bits of some floats
+	uint64_t HashFloats(uint64_t hash, const float* values, int numValues)
+	{
+		for (int value = 0; value < numValues; value++)
+		{
+			uint32_t bits;
+			memcpy(&bits, &values[value], sizeof(bits));
+			for (int byte = 0; byte < 4; byte++)
+			{
+				hash = (hash ^ ((bits >> (byte * 8)) & 0xffu)) * 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+
+	// every output after every sample, so that any difference anywhere changes the digest
+	uint64_t Digest(GamepadMotionHelpers::CalibrationMode mode, const std::vector<GamepadMotionHelpers::MotionSample>& stream)
+	{
+		GamepadMotion motion;
+		motion.SetCalibrationMode(mode);
+		uint64_t hash = 14695981039346656037ull;
+		for (const GamepadMotionHelpers::MotionSample& sample : stream)
+		{
+			motion.ProcessMotion(sample.GyroX, sample.GyroY, sample.GyroZ, sample.AccelX, sample.AccelY, sample.AccelZ, sample.DeltaTime);
+			float outputs[16];
+			motion.GetCalibratedGyro(outputs[0], outputs[1], outputs[2]);
+			motion.GetOrientation(outputs[3], outputs[4], outputs[5], outputs[6]);
+			motion.GetGravity(outputs[7], outputs[8], outputs[9]);
+			motion.GetProcessedAcceleration(outputs[10], outputs[11], outputs[12]);
+			motion.GetCalibrationOffset(outputs[13], outputs[14], outputs[15]);
+			hash = HashFloats(hash, outputs, 16);
+		}
+		return hash;
+	}
+
+	// degrees between the accelerometer's up and the orientation's up
+	float GetTiltError(GamepadMotion& motion, float accelX, float accelY, float accelZ)
+	{
+		float w, x, y, z;
+		motion.GetOrientation(w, x, y, z);
+		const GamepadMotionHelpers::Vec up = GamepadMotionHelpers::Vec(0.f, 1.f, 0.f) * GamepadMotionHelpers::Quat(w, x, y, z).Inverse();
+		const GamepadMotionHelpers::Vec accel(accelX, accelY, accelZ);
+		const float cosAngle = up.Dot(accel) / (up.Length() * accel.Length());
+		return acosf(std::min(1.f, cosAngle)) * 180.f / (float)M_PI;
+	}
+
+	// rests level for a couple of seconds, then tilted around z with no rotation on the gyro, like a controller that's
+	// been set down at an angle its orientation hasn't caught up with. Gravity correction should bring the orientation
+	// to within GravityCorrectMinAngle of the accelerometer, where it stops correcting
+	bool CheckGravityCorrection()
+	{
+		const float sampleRates[] = { 250.f, 1000.f };
+		const float tilts[] = { 1.f, 20.f };
+		const float settleTime = 2.f;
+		const float correctTime = 20.f;
+		const float maxError = 0.1f;
+
+		bool passed = true;
+		for (float sampleRate : sampleRates)
+		{
+			for (float tilt : tilts)
+			{
+				GamepadMotion motion;
+				const float deltaTime = 1.f / sampleRate;
+				for (int i = 0; i < (int)(settleTime * sampleRate); i++)
+				{
+					motion.ProcessMotion(0.f, 0.f, 0.f, 0.f, 1.f, 0.f, deltaTime);
+				}
+
+				const float tiltRadians = tilt * (float)M_PI / 180.f;
+				const float accelX = sinf(tiltRadians);
+				const float accelY = cosf(tiltRadians);
+				const float startError = GetTiltError(motion, accelX, accelY, 0.f);
+				for (int i = 0; i < (int)(correctTime * sampleRate); i++)
+				{
+					motion.ProcessMotion(0.f, 0.f, 0.f, accelX, accelY, 0.f, deltaTime);
+				}
+				const float error = GetTiltError(motion, accelX, accelY, 0.f);
+
+				const bool converged = error < maxError;
+				printf("%6.0f Hz, %4.1f degree tilt: %8.4f degrees off at the start, %8.4f after %.0f s %s\n", sampleRate, tilt,
+					startError, error, correctTime, converged ? "ok" : "FAILED");
+				passed = passed && converged;
+			}
+		}
+		return passed;
+	}
+
+	// one way a snapshot's sliding window can be corrupted
+	struct SnapshotCorruption
+	{
+		const char* Name;
+		void (*Corrupt)(GamepadMotionHelpers::AutoCalibrationSnapshot& snapshot);
+	};
+
+	// saves a controller whose stillness sliding window is in use, then loads it back after corrupting it in each way
+	// LoadSnapshot should catch. Each load should fail and leave the target exactly as it was
+	bool CheckSnapshots()
+	{
+		const SnapshotCorruption corruptions[] = {
+			{ "oldest bucket below 0", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowOldest = -1; } },
+			{ "oldest bucket past the end", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowOldest = GamepadMotionHelpers::SensorSlidingWindow::NumBuckets; } },
+			{ "negative older buckets", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowNumOlder = -1; } },
+			{ "no newer bucket", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowNumNewer = 0; } },
+			{ "more buckets than there are", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowNumOlder = GamepadMotionHelpers::SensorSlidingWindow::NumBuckets; s.SlidingWindowNumNewer = 1; } },
+			{ "NaN bucket time", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowBucketTime = NAN; } },
+			{ "negative bucket time", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowBucketTime = -1.f; } },
+			{ "infinite bucket time", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowBucketTime = INFINITY; } },
+			{ "negative bucket samples", [](GamepadMotionHelpers::AutoCalibrationSnapshot& s) { s.SlidingWindowBuckets[3].NumSamples = -1; } },
+		};
+
+		GamepadMotion source;
+		source.Settings.StillnessWindowTime = 2.f;
+		source.SetCalibrationMode(GamepadMotionHelpers::Stillness);
+		for (int i = 0; i < 1000; i++)
+		{
+			source.ProcessMotion(0.5f, -0.25f, 0.1f, 0.f, 1.f, 0.f, 1.f / 250.f);
+		}
+		GamepadMotionSnapshot good;
+		source.SaveSnapshot(good);
+
+		// a controller that's never used its window has to load too
+		GamepadMotion fresh;
+		GamepadMotionSnapshot freshSnapshot;
+		fresh.SaveSnapshot(freshSnapshot);
+
+		GamepadMotion target;
+		GamepadMotionPool<4> pool;
+		bool passed = target.LoadSnapshot(freshSnapshot) && pool.LoadSnapshot(1, freshSnapshot);
+		printf("%-30s %s\n", "unused window", passed ? "loaded" : "FAILED to load");
+		const bool goodLoaded = target.LoadSnapshot(good) && pool.LoadSnapshot(1, good);
+		printf("%-30s %s\n", "uncorrupted", goodLoaded ? "loaded" : "FAILED to load");
+		passed = passed && goodLoaded;
+
+		// what the targets should stay as, from here on
+		GamepadMotionSnapshot before, poolBefore, after;
+		target.SaveSnapshot(before);
+		pool.SaveSnapshot(1, poolBefore);
+
+		for (const SnapshotCorruption& corruption : corruptions)
+		{
+			GamepadMotionSnapshot bad = good;
+			corruption.Corrupt(bad.AutoCalibration);
+
+			bool rejected = !target.LoadSnapshot(bad);
+			target.SaveSnapshot(after);
+			rejected = rejected && memcmp(&before, &after, sizeof(before)) == 0;
+
+			bool poolRejected = !pool.LoadSnapshot(1, bad);
+			pool.SaveSnapshot(1, after);
+			poolRejected = poolRejected && memcmp(&poolBefore, &after, sizeof(poolBefore)) == 0;
+
+			printf("%-30s %s\n", corruption.Name, rejected && poolRejected ? "rejected" : "FAILED");
+			passed = passed && rejected && poolRejected;
+		}
+		return passed;
+	}
+
+	// two consecutive input reports from a PlayStation controller, a few milliseconds apart, each with the raw gyro
+	// (160, -320, 480) and accelerometer (8192, -4096, 2048)
+	struct PlayStationHidFixture
+	{
+		const char* Name;
+		GamepadMotionHidLayout Layout;
+		int NumBytes; // as the controller sends them
+		int MinBytes; // the shortest the reader should accept
+		uint8_t First[78];
+		uint8_t Second[78];
+	};
+
+	bool IsNear(float value, float expected)
+	{
+		return fabsf(value - expected) <= 1e-4f;
+	}
+
+	bool CheckPlayStationReports(const PlayStationHidFixture& fixture)
+	{
+		GamepadMotion motion;
+		GamepadMotionHidReader reader(motion, fixture.Layout);
+
+		uint8_t wrongId[78];
+		memcpy(wrongId, fixture.Second, sizeof(wrongId));
+		wrongId[0] = 0x05;
+
+		// the first report only sets the time to measure from, and bad reports shouldn't be read at all
+		float gyro[3] = {};
+		bool passed = reader.ProcessReport(fixture.First, fixture.NumBytes, gyro) == 0;
+		passed = passed && reader.ProcessReport(fixture.Second, fixture.MinBytes - 1, gyro) == 0;
+		passed = passed && reader.ProcessReport(wrongId, fixture.NumBytes, gyro) == 0;
+		passed = passed && reader.ProcessReport(fixture.Second, fixture.NumBytes, gyro) == 1;
+
+		// in GamepadMotionHelpers' units, 16 per degree per second and 8192 per g, with the same axes and signs
+		GamepadMotionSnapshot snapshot;
+		motion.SaveSnapshot(snapshot);
+		passed = passed && IsNear(gyro[0], 10.f) && IsNear(gyro[1], -20.f) && IsNear(gyro[2], 30.f);
+		passed = passed && IsNear(snapshot.RawAccel[0], 1.f) && IsNear(snapshot.RawAccel[1], -0.5f) && IsNear(snapshot.RawAccel[2], 0.25f);
+
+		printf("%-30s gyro %g %g %g, accel %g %g %g %s\n", fixture.Name, gyro[0], gyro[1], gyro[2],
+			snapshot.RawAccel[0], snapshot.RawAccel[1], snapshot.RawAccel[2], passed ? "decoded" : "FAILED");
+		return passed;
+	}
+
+	// a Switch Pro Controller report 0x30 with three different samples, each raw accel xyz then gyro xyz in the
+	// controller's own axes
+	bool CheckSwitchProReport()
+	{
+		const uint8_t report[64] = {
+			0x30, 0x42, 0x8e, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80, 0x00, 0x08, 0x80, 0x0b,
+			// accel (4096, 2048, -1024), gyro (143, -286, 429)
+			0x00, 0x10, 0x00, 0x08, 0x00, 0xfc, 0x8f, 0x00, 0xe2, 0xfe, 0xad, 0x01,
+			// accel (2048, -4096, 1024), gyro (-143, 286, 715)
+			0x00, 0x08, 0x00, 0xf0, 0x00, 0x04, 0x71, 0xff, 0x1e, 0x01, 0xcb, 0x02,
+			// accel (-1024, 1024, 4096), gyro (286, 143, -143)
+			0x00, 0xfc, 0x00, 0x04, 0x00, 0x10, 0x1e, 0x01, 0x8f, 0x00, 0x71, 0xff,
+		};
+		const int minBytes = 49;
+
+		// its x is our -z, its y our -x and its z our y, so each sample's gyro should come out as (-y, z, -x) at 14.2842
+		// per degree per second
+		const float expectedGyro[GamepadMotionHidReader::MaxSamplesPerReport * 3] = {
+			286.f, 429.f, -143.f,
+			-286.f, 715.f, 143.f,
+			-143.f, -143.f, -286.f,
+		};
+		// and the last sample's accel as (-y, z, -x) at 4096 per g
+		const float expectedAccel[3] = { -0.25f, 1.f, 0.25f };
+
+		GamepadMotion motion;
+		GamepadMotionHidReader reader(motion, GamepadMotionHidLayout::SwitchPro);
+
+		uint8_t wrongId[64];
+		memcpy(wrongId, report, sizeof(wrongId));
+		wrongId[0] = 0x21;
+
+		float gyro[GamepadMotionHidReader::MaxSamplesPerReport * 3] = {};
+		bool passed = reader.ProcessReport(report, minBytes - 1, gyro) == 0;
+		passed = passed && reader.ProcessReport(wrongId, sizeof(wrongId), gyro) == 0;
+		passed = passed && reader.ProcessReport(report, sizeof(report), gyro) == GamepadMotionHidReader::MaxSamplesPerReport;
+
+		GamepadMotionSnapshot snapshot;
+		motion.SaveSnapshot(snapshot);
+		for (int i = 0; i < GamepadMotionHidReader::MaxSamplesPerReport * 3; i++)
+		{
+			passed = passed && IsNear(gyro[i], expectedGyro[i] / 14.2842f);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			passed = passed && IsNear(snapshot.RawAccel[i], expectedAccel[i]);
+		}
+
+		printf("%-30s gyro %g %g %g, accel %g %g %g %s\n", "Switch Pro", gyro[6], gyro[7], gyro[8],
+			snapshot.RawAccel[0], snapshot.RawAccel[1], snapshot.RawAccel[2], passed ? "decoded" : "FAILED");
+		return passed;
+	}
+
+	// reads fixed-byte reports in each GamepadMotionHidLayout, checking the decoded axes, signs and units, and that
+	// reports that are too short or have the wrong ID are skipped
+	bool CheckHidReports()
+	{
+		const PlayStationHidFixture fixtures[] = {
+			{ "DualShock 4 USB", GamepadMotionHidLayout::DualShock4, 64, 25,
+				// timestamp 0x1000 at byte 10, gyro then accel from byte 13
+				{ 0x01, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x1b,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08 },
+				{ 0x01, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x04, 0x00, 0x00, 0xe2, 0x14, 0x1b,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08 } },
+			{ "DualShock 4 Bluetooth", GamepadMotionHidLayout::DualShock4, 78, 27,
+				// 2 more bytes first: timestamp at byte 12, gyro then accel from byte 15
+				{ 0x11, 0xc0, 0x00, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x1b,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08 },
+				{ 0x11, 0xc0, 0x00, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x04, 0x00, 0x00, 0xe2, 0x14, 0x1b,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08 } },
+			{ "DualSense USB", GamepadMotionHidLayout::DualSense, 64, 32,
+				// gyro then accel from byte 16, timestamp 0x100000 at byte 28
+				{ 0x01, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08, 0x00, 0x00, 0x10, 0x00 },
+				{ 0x01, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08, 0xe0, 0x2e, 0x10, 0x00 } },
+			{ "DualSense Bluetooth", GamepadMotionHidLayout::DualSense, 78, 33,
+				// just 1 more byte first: gyro then accel from byte 17, timestamp at byte 29
+				{ 0x31, 0x10, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08, 0x00, 0x00, 0x10, 0x00 },
+				{ 0x31, 0x20, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+					0xa0, 0x00, 0xc0, 0xfe, 0xe0, 0x01, 0x00, 0x20, 0x00, 0xf0, 0x00, 0x08, 0xe0, 0x2e, 0x10, 0x00 } },
+		};
+
+		bool passed = true;
+		for (const PlayStationHidFixture& fixture : fixtures)
+		{
+			passed = CheckPlayStationReports(fixture) && passed;
+		}
+		passed = CheckSwitchProReport() && passed;
+		return passed;
+	}
+
+	struct ExpectedDigest
+	{
+		std::string ModeName;
+		uint64_t Digest;
+	};
+
+	// lines of "mode digest", skipping blank lines and lines starting with #
+	bool LoadExpectedDigests(const char* path, std::vector<ExpectedDigest>& digests)
+	{
+		FILE* file = fopen(path, "r");
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		char line[256];
+		while (fgets(line, sizeof(line), file) != nullptr)
+		{
+			char modeName[64];
+			uint64_t digest;
+			if (line[0] != '#' && sscanf(line, "%63s %" SCNx64, modeName, &digest) == 2)
+			{
+				digests.push_back({ modeName, digest });
+			}
+		}
+		fclose(file);
+		return !digests.empty();
+	}
+
+	std::vector<int> ParseControllerCounts(const char* list)
+	{
+		std::vector<int> counts;
+		const char* cursor = list;
+		while (*cursor != '\0')
+		{
+			char* end;
+			const long count = strtol(cursor, &end, 10);
+			if (end == cursor)
+			{
+				break;
+			}
+			if (count >= 1 && count <= MaxBenchControllers)
+			{
+				counts.push_back((int)count);
+			}
+			cursor = *end == ',' ? end + 1 : end;
+		}
+		return counts;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int samplesPerController = 20000;
+	int batchSize = 8;
+	std::vector<int> controllerCounts = { 1, 2, 4, 8, 16, 32, 64 };
+	const char* tracePath = nullptr;
+	bool digest = false;
+	const char* expectPath = nullptr;
+	bool accuracy = false;
+	bool snapshots = false;
+	bool hid = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--samples") == 0 && hasValue)
+		{
+			samplesPerController = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--batch") == 0 && hasValue)
+		{
+			batchSize = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--controllers") == 0 && hasValue)
+		{
+			controllerCounts = ParseControllerCounts(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			tracePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--digest") == 0)
+		{
+			digest = true;
+		}
+		else if (strcmp(argv[i], "--expect") == 0 && hasValue)
+		{
+			expectPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--accuracy") == 0)
+		{
+			accuracy = true;
+		}
+		else if (strcmp(argv[i], "--snapshots") == 0)
+		{
+			snapshots = true;
+		}
+		else if (strcmp(argv[i], "--hid") == 0)
+		{
+			hid = true;
+		}
+		else
+		{
+			printf("Usage: %s [--samples N] [--batch N] [--controllers 1,4,16,64] [--trace file] [--digest [--expect file]] [--accuracy] [--snapshots] [--hid]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (accuracy)
+	{
+		return CheckGravityCorrection() ? 0 : 1;
+	}
+	if (snapshots)
+	{
+		return CheckSnapshots() ? 0 : 1;
+	}
+	if (hid)
+	{
+		return CheckHidReports() ? 0 : 1;
+	}
+
+	std::vector<GamepadMotionHelpers::MotionSample> stream;
+	if (tracePath != nullptr)
+	{
+		if (!LoadStream(tracePath, stream))
+		{
+			printf("Couldn't read any samples from %s\n", tracePath);
+			return 1;
+		}
+	}
+	else
+	{
+		stream = MakeSyntheticStream(60000);
+	}
+
+	const GamepadMotionHelpers::CalibrationMode modes[] = {
+		GamepadMotionHelpers::CalibrationMode::Manual,
+		GamepadMotionHelpers::CalibrationMode::Stillness,
+		GamepadMotionHelpers::CalibrationMode::SensorFusion,
+		GamepadMotionHelpers::CalibrationMode::Stillness | GamepadMotionHelpers::CalibrationMode::SensorFusion,
+	};
+	const Api apis[] = { Api::ProcessMotion, Api::ProcessMotionBatch, Api::Pool };
+
+	if (digest)
+	{
+		std::vector<ExpectedDigest> expectedDigests;
+		if (expectPath != nullptr && !LoadExpectedDigests(expectPath, expectedDigests))
+		{
+			printf("Couldn't read any digests from %s\n", expectPath);
+			return 1;
+		}
+
+#if defined(GAMEPADMOTION_DETERMINISTIC)
+		printf("digests of %d samples from %s, deterministic\n", (int)stream.size(), tracePath != nullptr ? tracePath : "synthetic stream");
+#else
+		printf("digests of %d samples from %s, not deterministic, so they may differ between platforms\n", (int)stream.size(),
+			tracePath != nullptr ? tracePath : "synthetic stream");
+#endif
+		bool matched = true;
+		for (GamepadMotionHelpers::CalibrationMode mode : modes)
+		{
+			const uint64_t modeDigest = Digest(mode, stream);
+			printf("%-24s %016" PRIx64, GetModeName(mode), modeDigest);
+			if (expectPath != nullptr)
+			{
+				const ExpectedDigest* expected = nullptr;
+				for (const ExpectedDigest& expectedDigest : expectedDigests)
+				{
+					if (expectedDigest.ModeName == GetModeName(mode))
+					{
+						expected = &expectedDigest;
+					}
+				}
+				if (expected == nullptr)
+				{
+					printf(" not in %s", expectPath);
+					matched = false;
+				}
+				else if (expected->Digest != modeDigest)
+				{
+					printf(" expected %016" PRIx64, expected->Digest);
+					matched = false;
+				}
+			}
+			printf("\n");
+		}
+		return matched ? 0 : 1;
+	}
+
+	CacheMissCounter cacheMisses;
+	printf("%d samples per controller from %s, batches of %d, cache misses %s\n", samplesPerController,
+		tracePath != nullptr ? tracePath : "synthetic stream", batchSize, cacheMisses.IsAvailable() ? "counted" : "unavailable");
+	printf("%-24s %-20s %11s %10s %14s %15s\n", "mode", "api", "controllers", "ns/sample", "samples/sec", "misses/sample");
+
+	float checksum = 0.f;
+	for (GamepadMotionHelpers::CalibrationMode mode : modes)
+	{
+		// ns/sample for each controller count, to compare the pool against separate objects afterwards
+		std::vector<double> processMotionTimes, poolTimes;
+		for (Api api : apis)
+		{
+			for (int numControllers : controllerCounts)
+			{
+				const RunResult result = Run(api, mode, numControllers, samplesPerController, batchSize, stream, cacheMisses);
+				const double totalSamples = (double)samplesPerController * numControllers;
+				if (api == Api::ProcessMotion)
+				{
+					processMotionTimes.push_back(result.Seconds * 1e9 / totalSamples);
+				}
+				else if (api == Api::Pool)
+				{
+					poolTimes.push_back(result.Seconds * 1e9 / totalSamples);
+				}
+				char missesText[32] = "n/a";
+				if (result.CacheMisses >= 0)
+				{
+					snprintf(missesText, sizeof(missesText), "%.4f", result.CacheMisses / totalSamples);
+				}
+				printf("%-24s %-20s %11d %10.1f %14.0f %15s\n", GetModeName(mode), GetApiName(api), numControllers,
+					result.Seconds * 1e9 / totalSamples, totalSamples / result.Seconds, missesText);
+				checksum += result.Checksum;
+			}
+		}
+
+		// the pool's time per sample as a multiple of ProcessMotion's, for each controller count
+		printf("%-24s %-20s", GetModeName(mode), "pool/ProcessMotion");
+		for (size_t i = 0; i < controllerCounts.size(); i++)
+		{
+			printf(" %d: %.2fx", controllerCounts[i], poolTimes[i] / processMotionTimes[i]);
+		}
+		printf("\n");
+	}
+
+	// so the work can't be optimised away
+	printf("checksum %f\n", checksum);
+	return 0;
+}
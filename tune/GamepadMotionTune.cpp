@@ -0,0 +1,234 @@
+// Copyright (c) 2020-2021 Julian "Jibb" Smart
+// Released under the MIT license. See https://github.com/JibbSmart/GamepadMotionHelpers/blob/main/LICENSE for more info
+
+// Offline settings tuner for GamepadMotionHelpers. Replays recorded traces with known gyro bias through many randomly
+// varied GamepadMotionSettings on every core, and prints the settings that calibrated best.
+//
+// Usage: GamepadMotionHelpers_tune --trace file --bias x,y,z [--trace file --bias x,y,z ...] [--candidates N]
+//     [--threads N] [--mode stillness|sensorfusion|both] [--threshold degreesPerSecond] [--top N] [--seed N]
+// Traces are binary traces (see GamepadMotionTrace.hpp). Each --bias is the true gyro bias of the --trace before it.
+
+#include "GamepadMotion.hpp"
+#include "GamepadMotionTrace.hpp"
+#include "GamepadMotionTuner.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+	struct TunedSetting
+	{
+		const char* Name;
+		float GamepadMotionSettings::* Value;
+	};
+
+	// the settings that affect calibration. Gravity correction doesn't, so it isn't tuned here
+	const TunedSetting TunedSettings[] = {
+		{ "MinStillnessTime", &GamepadMotionSettings::MinStillnessTime },
+		{ "MaxStillnessError", &GamepadMotionSettings::MaxStillnessError },
+		{ "StillnessSampleDeteriorationRate", &GamepadMotionSettings::StillnessSampleDeteriorationRate },
+		{ "StillnessErrorClimbRate", &GamepadMotionSettings::StillnessErrorClimbRate },
+		{ "StillnessErrorDropOnRecalibrate", &GamepadMotionSettings::StillnessErrorDropOnRecalibrate },
+		{ "StillnessCalibrationEaseInTime", &GamepadMotionSettings::StillnessCalibrationEaseInTime },
+		{ "StillnessCalibrationHalfTime", &GamepadMotionSettings::StillnessCalibrationHalfTime },
+		{ "SensorFusionCalibrationSmoothingStrength", &GamepadMotionSettings::SensorFusionCalibrationSmoothingStrength },
+		{ "SensorFusionAngularAccelerationThreshold", &GamepadMotionSettings::SensorFusionAngularAccelerationThreshold },
+		{ "SensorFusionCalibrationEaseInTime", &GamepadMotionSettings::SensorFusionCalibrationEaseInTime },
+		{ "SensorFusionCalibrationHalfTime", &GamepadMotionSettings::SensorFusionCalibrationHalfTime },
+	};
+
+	// deterministic so that runs are repeatable
+	class Random
+	{
+	public:
+		explicit Random(unsigned int seed) : State(seed) {}
+
+		float Next()
+		{
+			State = State * 1664525u + 1013904223u;
+			return ((State >> 8) / 16777216.f) * 2.f - 1.f;
+		}
+
+	private:
+		unsigned int State;
+	};
+
+	// each tuned setting scaled by up to 4x either way from the defaults
+	GamepadMotionSettings MakeCandidate(Random& random)
+	{
+		GamepadMotionSettings settings;
+		for (const TunedSetting& setting : TunedSettings)
+		{
+			settings.*setting.Value *= exp2f(random.Next() * 2.f);
+		}
+		settings.MinStillnessSamples = std::max(1, (int)(settings.MinStillnessSamples * exp2f(random.Next() * 2.f) + 0.5f));
+		return settings;
+	}
+
+	bool ParseBias(const char* text, float bias[3])
+	{
+		return sscanf(text, "%f,%f,%f", &bias[0], &bias[1], &bias[2]) == 3;
+	}
+
+	void PrintChangedSettings(const GamepadMotionSettings& settings)
+	{
+		const GamepadMotionSettings defaults;
+		if (settings.MinStillnessSamples != defaults.MinStillnessSamples)
+		{
+			printf("    Settings.MinStillnessSamples = %d;\n", settings.MinStillnessSamples);
+		}
+		for (const TunedSetting& setting : TunedSettings)
+		{
+			if (settings.*setting.Value != defaults.*setting.Value)
+			{
+				printf("    Settings.%s = %gf;\n", setting.Name, settings.*setting.Value);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	struct TraceArgument
+	{
+		const char* Path;
+		float Bias[3];
+		bool HasBias;
+	};
+	std::vector<TraceArgument> traceArguments;
+	int numCandidates = 256;
+	int numThreads = 0;
+	int numTop = 5;
+	unsigned int seed = 12345u;
+	float threshold = 0.5f;
+	GamepadMotionHelpers::CalibrationMode mode = GamepadMotionHelpers::CalibrationMode::Stillness | GamepadMotionHelpers::CalibrationMode::SensorFusion;
+
+	bool validArguments = true;
+	for (int i = 1; i < argc && validArguments; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			traceArguments.push_back({ argv[++i], { 0.f, 0.f, 0.f }, false });
+		}
+		else if (strcmp(argv[i], "--bias") == 0 && hasValue && !traceArguments.empty())
+		{
+			traceArguments.back().HasBias = ParseBias(argv[++i], traceArguments.back().Bias);
+			validArguments = traceArguments.back().HasBias;
+		}
+		else if (strcmp(argv[i], "--candidates") == 0 && hasValue)
+		{
+			numCandidates = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+		{
+			numThreads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--top") == 0 && hasValue)
+		{
+			numTop = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+		{
+			seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+		{
+			threshold = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--mode") == 0 && hasValue)
+		{
+			const char* modeName = argv[++i];
+			if (strcmp(modeName, "stillness") == 0)
+			{
+				mode = GamepadMotionHelpers::CalibrationMode::Stillness;
+			}
+			else if (strcmp(modeName, "sensorfusion") == 0)
+			{
+				mode = GamepadMotionHelpers::CalibrationMode::SensorFusion;
+			}
+			else
+			{
+				validArguments = strcmp(modeName, "both") == 0;
+			}
+		}
+		else
+		{
+			validArguments = false;
+		}
+	}
+
+	for (const TraceArgument& traceArgument : traceArguments)
+	{
+		validArguments = validArguments && traceArgument.HasBias;
+	}
+
+	if (!validArguments || traceArguments.empty())
+	{
+		printf("Usage: %s --trace file --bias x,y,z [--trace file --bias x,y,z ...] [--candidates N] [--threads N]\n"
+			"    [--mode stillness|sensorfusion|both] [--threshold degreesPerSecond] [--top N] [--seed N]\n", argv[0]);
+		return 1;
+	}
+
+	// keep every trace's samples for the whole run, since the tuner doesn't copy them
+	std::vector<std::vector<GamepadMotionHelpers::MotionSample>> traceSamples(traceArguments.size());
+	GamepadMotionTuner tuner;
+	tuner.SetCalibrationMode(mode);
+	tuner.SetCalibratedThreshold(threshold);
+	for (size_t trace = 0; trace < traceArguments.size(); trace++)
+	{
+		GamepadMotionTraceReader reader;
+		if (!reader.Open(traceArguments[trace].Path) || reader.GetNumSamples() <= 0)
+		{
+			printf("Couldn't read any samples from %s\n", traceArguments[trace].Path);
+			return 1;
+		}
+		std::vector<GamepadMotionHelpers::MotionSample>& samples = traceSamples[trace];
+		samples.resize(reader.GetNumSamples());
+		reader.Read(samples.data(), reader.GetNumSamples());
+		const float* bias = traceArguments[trace].Bias;
+		tuner.AddTrace(samples.data(), (int)samples.size(), bias[0], bias[1], bias[2]);
+	}
+
+	// the defaults are always candidate 0, to compare against
+	Random random(seed);
+	tuner.AddCandidate(GamepadMotionSettings());
+	for (int candidate = 1; candidate < numCandidates; candidate++)
+	{
+		tuner.AddCandidate(MakeCandidate(random));
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	tuner.Run(numThreads);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%d candidates on %d traces in %.2f seconds\n", tuner.GetNumCandidates(), tuner.GetNumTraces(), seconds);
+
+	std::vector<int> ranking(tuner.GetNumCandidates());
+	std::vector<GamepadMotionTunerScore> scores(tuner.GetNumCandidates());
+	for (int candidate = 0; candidate < tuner.GetNumCandidates(); candidate++)
+	{
+		ranking[candidate] = candidate;
+		scores[candidate] = tuner.GetScore(candidate);
+	}
+	std::sort(ranking.begin(), ranking.end(), [&scores](int a, int b) { return scores[a].MeanError < scores[b].MeanError; });
+
+	printf("%-10s %11s %11s %15s %16s\n", "candidate", "mean error", "worst final", "time to calib.", "never calibrated");
+	for (int rank = 0; rank < std::min(numTop, (int)ranking.size()); rank++)
+	{
+		const GamepadMotionTunerScore& score = scores[ranking[rank]];
+		printf("%-10d %11.4f %11.4f %15.2f %16d\n", ranking[rank], score.MeanError, score.WorstFinalError,
+			score.MeanTimeToCalibrate, score.NumNeverCalibrated);
+		PrintChangedSettings(tuner.GetCandidate(ranking[rank]));
+	}
+
+	const GamepadMotionTunerScore& defaultScore = scores[0];
+	printf("defaults: mean error %.4f, worst final %.4f, time to calibrate %.2f, never calibrated %d\n", defaultScore.MeanError,
+		defaultScore.WorstFinalError, defaultScore.MeanTimeToCalibrate, defaultScore.NumNeverCalibrated);
+	return 0;
+}